@@ -25,18 +25,402 @@
 #include <libusb.h>
 
 #include "linux-adk.h"
+#include "adk.h"
 #ifndef WIN32
 #include "hid.h"
+#include "histogram.h"
+#include "integrity.h"
+#include "mux.h"
+#include "pipeline.h"
+#include "ping.h"
+#include "rt.h"
+#include "shmring.h"
+#include "sink.h"
+#include "tune.h"
 #endif
+#include "trace.h"
+
+/* Pipeline buffers, holding a whole transfer each */
+#define BULK_PIPELINE_BUFFERS	128
+
+static void dump_data(uint8_t * buf, int len)
+{
+	int i;
+
+	printf("Received %d bytes\n", len);
+	for (i = 0; i < len;) {
+		printf("%#2.2x ", buf[i++]);
+		if (!(i % 8))
+			printf("\n");
+	}
+	printf("\n");
+}
+
+/* Consumer of the data received on the accessory interface */
+typedef struct {
+	accessory_t *acc;
+	uint64_t errors;
+#ifndef WIN32
+	sink_t *sink;
+	integrity_t integrity;
+	uint64_t mismatches;
+	pipeline_t *pipeline;
+	shmring_t *shm;
+#endif
+} bulk_stream;
+
+/*
+ * Processing stages, run inline by the USB thread or on their own threads
+ * when pipelined.
+ */
+#ifndef WIN32
+static int stage_integrity(void *ctx, uint8_t * buf, int len)
+{
+	bulk_stream *bs = ctx;
+
+	len = integrity_check(&bs->integrity, buf, len);
+	if (bs->integrity.mismatches != bs->mismatches) {
+		bs->mismatches = bs->integrity.mismatches;
+		trace(TRACE_ERROR, AOA_ACCESSORY_EP_IN, 0, len,
+		      bs->mismatches);
+	}
+
+	return len;
+}
+#endif
+
+static int stage_output(void *ctx, uint8_t * buf, int len)
+{
+#ifndef WIN32
+	bulk_stream *bs = ctx;
+
+	if (bs->shm && (shmring_write(bs->shm, buf, len) < 0))
+		trace(TRACE_DROP, AOA_ACCESSORY_EP_IN, 0, len, 0);
+	if (bs->sink) {
+		if (sink_write(bs->sink, buf, len) < 0)
+			trace(TRACE_DROP, AOA_ACCESSORY_EP_IN, 0, len, 0);
+		return len;
+	}
+	if (bs->shm)
+		return len;
+#endif
+	dump_data(buf, len);
+	return len;
+}
+
+static void bulk_data(bulk_stream * bs, uint8_t * buf, int len)
+{
+#ifndef WIN32
+	if (bs->acc->integrity) {
+		len = stage_integrity(bs, buf, len);
+		if (!len)
+			return;
+	}
+#endif
+	stage_output(bs, buf, len);
+}
+
+#ifndef WIN32
+enum {
+	BULK_STAGE_INTEGRITY,
+	BULK_STAGE_OUTPUT,
+	BULK_STAGES,
+};
+
+static const char *const bulk_stage_names[BULK_STAGES] = {
+	"integrity",
+	"output",
+};
+
+/*
+ * Parses the "name[:prio[:cpu]],..." scheduling of the stages, which
+ * otherwise run at the bulk thread priority, unpinned not to compete with
+ * it for its CPU.
+ */
+static int parse_stages(const accessory_t * acc, int *prio, int *cpu)
+{
+	const char *p = acc->stages;
+	int i;
+
+	for (i = 0; i < BULK_STAGES; i++) {
+		prio[i] = acc->bulk_prio;
+		cpu[i] = -1;
+	}
+
+	while (p && *p) {
+		size_t len = strcspn(p, ":,");
+		char *end;
+
+		for (i = 0; i < BULK_STAGES; i++)
+			if ((strlen(bulk_stage_names[i]) == len) &&
+			    !strncmp(p, bulk_stage_names[i], len))
+				break;
+		if (i == BULK_STAGES) {
+			printf("Unknown pipeline stage %.*s\n", (int)len, p);
+			return -1;
+		}
+
+		p += len;
+		if (*p == ':') {
+			prio[i] = strtol(p + 1, &end, 10);
+			p = end;
+			if (*p == ':') {
+				cpu[i] = strtol(p + 1, &end, 10);
+				p = end;
+			}
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p) {
+			printf("Invalid pipeline stages %s\n", acc->stages);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int bulk_pipeline(accessory_t * acc, bulk_stream * bs)
+{
+	int size = acc->autotune ? TUNE_MAX_SIZE : 512;
+	int prio[BULK_STAGES], cpu[BULK_STAGES];
+
+	if (parse_stages(acc, prio, cpu) != 0)
+		return -1;
+
+	bs->pipeline = pipeline_create(BULK_PIPELINE_BUFFERS, size);
+	if (bs->pipeline == NULL)
+		return -1;
+
+	if (acc->integrity)
+		pipeline_add_stage(bs->pipeline,
+				   bulk_stage_names[BULK_STAGE_INTEGRITY],
+				   stage_integrity, bs,
+				   prio[BULK_STAGE_INTEGRITY],
+				   cpu[BULK_STAGE_INTEGRITY]);
+	pipeline_add_stage(bs->pipeline, bulk_stage_names[BULK_STAGE_OUTPUT],
+			   stage_output, bs, prio[BULK_STAGE_OUTPUT],
+			   cpu[BULK_STAGE_OUTPUT]);
+
+	return pipeline_start(bs->pipeline);
+}
+
+/*
+ * Hands received data over, to the pipeline if any. The USB thread never
+ * waits for a buffer: without a free one, data has been read to a scratch
+ * buffer and is dropped.
+ */
+static void bulk_receive(bulk_stream * bs, pipeline_buf ** pbuf,
+			 uint8_t * buf, int len)
+{
+	if (!bs->pipeline) {
+		bulk_data(bs, buf, len);
+	} else if (*pbuf) {
+		pipeline_put(bs->pipeline, *pbuf, len);
+		*pbuf = NULL;
+	} else {
+		pipeline_drop(bs->pipeline, len);
+	}
+}
+#endif
+
+#ifndef WIN32
+/*
+ * Auto-tuned reception: a queue of asynchronous reads whose size and
+ * depth follow the tuner. Reads complete in submission order, so data
+ * stays in order whatever the depth.
+ */
+typedef struct bulk_queue bulk_queue;
+
+typedef struct {
+	bulk_queue *queue;
+	int index;
+	int active;
+	uint64_t submit_ns;
+	unsigned char *buf;
+	pipeline_buf *pbuf;
+} bulk_slot;
+
+struct bulk_queue {
+	accessory_t *acc;
+	bulk_stream *bs;
+	tune_t *tune;
+	int size;
+	int depth;
+	volatile int inflight;
+	int errors;
+	uint64_t last_complete;
+	bulk_slot slots[TUNE_MAX_DEPTH];
+};
+
+static void callback_bulk(adk_ctx * adk, int status, unsigned char *buf,
+			  int len, void *user_data);
+
+static void bulk_submit(bulk_slot * slot)
+{
+	bulk_queue *queue = slot->queue;
+	unsigned char *buf = slot->buf;
+
+	if (queue->bs->pipeline && !slot->pbuf)
+		slot->pbuf = pipeline_get(queue->bs->pipeline);
+	if (slot->pbuf)
+		buf = slot->pbuf->data;
+
+	slot->submit_ns = time_ns();
+	if (adk_submit_read(queue->acc->adk, buf, queue->size, 200,
+			    callback_bulk, slot) != 0)
+		return;
+
+	slot->active = 1;
+	queue->inflight++;
+}
+
+static void callback_bulk(adk_ctx * adk, int status, unsigned char *buf,
+			  int len, void *user_data)
+{
+	bulk_slot *slot = user_data;
+	bulk_queue *queue = slot->queue;
+	uint64_t now = time_ns();
+	int i, depth = queue->depth;
+
+	slot->active = 0;
+	queue->inflight--;
+
+	if (len > 0) {
+		/* A read only starts filling once the previous one is done */
+		uint64_t start = slot->submit_ns > queue->last_complete ?
+		    slot->submit_ns : queue->last_complete;
+
+		queue->last_complete = now;
+		bulk_receive(queue->bs, &slot->pbuf, buf, len);
+		if (tune_complete(queue->tune, len, now - start))
+			tune_params(queue->tune, &queue->size, &queue->depth);
+	} else if (tune_complete(queue->tune, 0, 0)) {
+		tune_params(queue->tune, &queue->size, &queue->depth);
+	}
+
+	if (status && (status != LIBUSB_ERROR_TIMEOUT)) {
+		queue->bs->errors++;
+		trace(TRACE_ERROR, AOA_ACCESSORY_EP_IN, status, len,
+		      queue->bs->errors);
+		if (queue->errors > 0)
+			queue->errors--;
+	}
+	if (stop_acc || !queue->errors)
+		return;
+
+	if (slot->index < queue->depth)
+		bulk_submit(slot);
+	for (i = depth; i < queue->depth; i++)
+		if (!queue->slots[i].active)
+			bulk_submit(&queue->slots[i]);
+}
+
+static void bulk_autotune(accessory_t * acc, bulk_stream * bs)
+{
+	bulk_queue queue;
+	unsigned int target = 0;
+	char serial[128];
+	int i;
+
+	memset(&queue, 0, sizeof(queue));
+	if (strcmp(acc->autotune, "throughput"))
+		target = strtoul(acc->autotune, NULL, 10);
+
+	adk_get_serial(acc->adk, serial, sizeof(serial));
+	queue.tune = tune_open(acc->tune_cache, serial, target);
+	if (queue.tune == NULL)
+		return;
+
+	queue.acc = acc;
+	queue.bs = bs;
+	queue.errors = 20;
+	tune_params(queue.tune, &queue.size, &queue.depth);
+	for (i = 0; i < TUNE_MAX_DEPTH; i++) {
+		queue.slots[i].queue = &queue;
+		queue.slots[i].index = i;
+		queue.slots[i].buf = malloc(TUNE_MAX_SIZE);
+		if (queue.slots[i].buf == NULL)
+			goto end;
+	}
+
+	for (i = 0; i < queue.depth; i++)
+		bulk_submit(&queue.slots[i]);
+
+	/* Reads time out regularly, so the queue drains once stopped */
+	while (queue.inflight > 0)
+		adk_handle_events(acc->adk, 100);
+
+end:
+	tune_close(queue.tune);
+	for (i = 0; i < TUNE_MAX_DEPTH; i++)
+		free(queue.slots[i].buf);
+}
+#endif
+
+/* Synchronous reception, one read at a time */
+static void bulk_loop(accessory_t * acc, bulk_stream * bs)
+{
+	uint8_t acc_buf[512];
+	uint8_t *buf = acc_buf;
+	int transferred;
+	int errors = 20;
+	int ret;
+#ifndef WIN32
+	pipeline_buf *pbuf = NULL;
+
+	rt_prefault(acc_buf, sizeof(acc_buf));
+#endif
+
+	/* Snooping loop; Display every data received from device */
+	while (!stop_acc) {
+#ifndef WIN32
+		if (bs->pipeline && !pbuf)
+			pbuf = pipeline_get(bs->pipeline);
+		buf = pbuf ? pbuf->data : acc_buf;
+#endif
+		ret = adk_read(acc->adk, buf, sizeof(acc_buf), &transferred,
+			       200);
+		if (ret < 0) {
+			if (ret == LIBUSB_ERROR_TIMEOUT)
+				continue;
+			bs->errors++;
+			trace(TRACE_ERROR, AOA_ACCESSORY_EP_IN, ret, 0,
+			      bs->errors);
+			if (--errors == 0)
+				break;
+			else
+				sleep(1);
+		}
+
+#ifndef WIN32
+		bulk_receive(bs, &pbuf, buf, transferred);
+#else
+		bulk_data(bs, buf, transferred);
+#endif
+	}
+}
 
 void accessory_main(accessory_t * acc)
 {
-	int ret = 0;
+	uint16_t pid = adk_get_pid(acc->adk);
+	int ret;
 #ifndef WIN32
+	static hid_latency hid_lat, vhid_lat;
 	hid_device hid;
+	hid_device vhid;
+	int injecting = 0;
+
+	hid.handle = NULL;
+	hid.latency = NULL;
+	if (acc->hid_latency) {
+		hid_latency_init(&hid_lat, HID_PHYSICAL_ID);
+		hid_latency_init(&vhid_lat, HID_VIRTUAL_ID);
+		hid.latency = &hid_lat;
+	}
 
 	/* In case of Audio/HID support */
-	if (acc->pid >= AOA_AUDIO_PID) {
+	if (pid >= AOA_AUDIO_PID) {
 		/* Audio warning */
 		printf("Device should now be recognized as valid ALSA card...\n");
 		printf("  => arecord -l\n");
@@ -47,50 +431,106 @@ void accessory_main(accessory_t * acc)
 			send_hid_descriptor(acc, &hid);
 		}
 	}
+
+	/* Virtual HID device fed by an external source */
+	if (acc->hid_inject) {
+		vhid.latency = acc->hid_latency ? &vhid_lat : NULL;
+		if ((load_hid_descriptor(&vhid, acc->hid_inject) == 0) &&
+		    (start_hid_injection(acc, &vhid, acc->hid_input) == 0))
+			injecting = 1;
+	}
 #endif
 	/* If we have an accessory interface */
-	if ((acc->pid != AOA_AUDIO_ADB_PID) && (acc->pid != AOA_AUDIO_PID)) {
-		uint8_t acc_buf[512];
-		int transferred, i;
-		int errors = 20;
+	if ((pid != AOA_AUDIO_ADB_PID) && (pid != AOA_AUDIO_PID)) {
+		bulk_stream bs;
+
+		memset(&bs, 0, sizeof(bs));
+		bs.acc = acc;
 
 		/* Claiming first (accessory )interface from the opened device */
-		ret =
-		    libusb_claim_interface(acc->handle,
-					   AOA_ACCESSORY_INTERFACE);
+		ret = adk_claim(acc->adk);
 		if (ret != 0) {
-			printf("Error %d claiming interface...\n", ret);
+			printf("Error claiming interface: %s\n",
+			       adk_strerror(ret));
+#ifndef WIN32
+			/* The HID threads still use the accessory */
+			stop_acc = 1;
+			goto release;
+#else
 			return;
+#endif
 		}
+#ifndef WIN32
+		integrity_init(&bs.integrity);
 
-		/* Snooping loop; Display every data received from device */
-		while (!stop_acc) {
-			ret =
-			    libusb_bulk_transfer(acc->handle,
-						 AOA_ACCESSORY_EP_IN, acc_buf,
-						 sizeof(acc_buf), &transferred,
-						 200);
-			if (ret < 0) {
-				if (ret == LIBUSB_ERROR_TIMEOUT)
-					continue;
-				printf("bulk transfer error %d\n", ret);
-				if (--errors == 0)
-					break;
-				else
-					sleep(1);
-			}
+		/* Round-trip measurement instead of reception */
+		if (acc->ping || acc->ping_sweep) {
+			rt_configure_thread("bulk", acc->bulk_prio,
+					    acc->bulk_cpu);
+			ping_main(acc);
+			goto drain;
+		}
 
-			printf("Received %d bytes\n", transferred);
-			for (i = 0; i < transferred;) {
-				printf("%#2.2x ", acc_buf[i++]);
-				if (!(i % 8))
-					printf("\n");
-			}
-			printf("\n");
+		/* Channels for local clients instead of reception */
+		if (acc->mux) {
+			rt_configure_thread("bulk", acc->bulk_prio,
+					    acc->bulk_cpu);
+			mux_main(acc);
+			goto drain;
+		}
+
+		/* Capture to disk instead of displaying */
+		if (acc->output) {
+			bs.sink = sink_open(acc->output, acc->output_direct,
+					    (uint64_t)acc->rotate_size << 20,
+					    acc->rotate_time);
+			if (bs.sink == NULL)
+				goto drain;
 		}
+
+		/* Publish to local consumers */
+		if (acc->shm_ring) {
+			bs.shm = shmring_create(acc->shm_ring,
+						SHMRING_DEFAULT_SIZE);
+			if (bs.shm == NULL)
+				goto drain;
+		}
+
+		if (acc->pipeline && (bulk_pipeline(acc, &bs) != 0))
+			goto drain;
+		rt_configure_thread("bulk", acc->bulk_prio, acc->bulk_cpu);
+
+		if (acc->autotune)
+			bulk_autotune(acc, &bs);
+		else
+#endif
+			bulk_loop(acc, &bs);
+#ifndef WIN32
+drain:
+		/* Drains the stages, which may still be writing to the sink */
+		if (bs.pipeline)
+			pipeline_close(bs.pipeline);
+		if (bs.sink)
+			sink_close(bs.sink);
+		if (bs.shm)
+			shmring_destroy(bs.shm);
+		if (acc->integrity)
+			integrity_report(&bs.integrity, "Bulk IN");
+#endif
+		if (bs.errors)
+			printf("Bulk IN: %llu transfer errors\n",
+			       (unsigned long long)bs.errors);
 	}
 #ifndef WIN32
-	if ((acc->pid >= AOA_AUDIO_PID) && (hid.handle))
+release:
+	if ((pid >= AOA_AUDIO_PID) && (hid.handle))
 		pthread_join(hid.rx_thread, NULL);
+	if (injecting)
+		stop_hid_injection(&vhid);
+
+	if ((pid >= AOA_AUDIO_PID) && hid.handle && hid.latency)
+		hid_latency_report(hid.latency);
+	if (injecting && vhid.latency)
+		hid_latency_report(vhid.latency);
 #endif
 }
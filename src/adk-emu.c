@@ -0,0 +1,846 @@
+/*
+ * Linux ADK - adk-emu.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * AOA phone emulator: presents, through configfs and FunctionFS, a USB
+ * device answering the Android Open Accessory requests. Once asked to
+ * start in accessory mode it re-enumerates as 18d1:2d00 and sources/sinks
+ * bulk data at configurable rates, and accepts HID registration and
+ * events. Used with dummy_hcd, it is a local stand-in for a phone to
+ * benchmark linux-adk.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <endian.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <sys/ioctl.h>
+#include <linux/usb/ch9.h>
+#include <linux/usb/functionfs.h>
+
+#include "linux-adk.h"
+#include "integrity.h"
+
+#define EMU_GADGET_DIR		"/sys/kernel/config/usb_gadget/adk-emu"
+#define EMU_FFS_NAME		"adk"
+#define EMU_FFS_DIR		"/dev/ffs-adk"
+#define EMU_DEFAULT_DEVICE	"18d1:4e42"
+#define EMU_DEFAULT_BLOCK	16384
+#define EMU_MAX_BLOCK		(1024 * 1024)
+#define EMU_HID_MAX		8
+
+/* Constant byte swapping, usable in the descriptors initializers */
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define cpu_to_le16(x)	(x)
+#define cpu_to_le32(x)	(x)
+#else
+#define cpu_to_le16(x)	((((x) >> 8) & 0xffu) | (((x) & 0xffu) << 8))
+#define cpu_to_le32(x)	((((x) & 0xff000000u) >> 24) | \
+			 (((x) & 0x00ff0000u) >> 8) | \
+			 (((x) & 0x0000ff00u) << 8) | \
+			 (((x) & 0x000000ffu) << 24))
+#endif
+
+typedef struct {
+	uint16_t id;
+	int registered;
+	int descriptor_size;
+	int descriptor_len;
+	uint64_t events;
+	uint64_t event_bytes;
+} emu_hid;
+
+typedef struct {
+	const char *udc;
+	int bound;
+	uint16_t vid;
+	uint16_t pid;
+	int ep0;
+	int ep_in;
+	int ep_out;
+	int ep_in_packet;	/* wMaxPacketSize at the negotiated speed */
+	int accessory;
+	uint64_t source_rate;
+	uint64_t sink_rate;
+	size_t block_size;
+	int integrity;
+	int echo;
+	int verbose;
+	char ident[6][256];
+	emu_hid hid[EMU_HID_MAX];
+	volatile uint64_t tx_bytes;
+	volatile uint64_t rx_bytes;
+	volatile uint64_t hid_events;
+} emu_t;
+
+static volatile int stop_emu = 0;
+
+static const struct {
+	struct usb_functionfs_descs_head_v2 header;
+	__le32 fs_count;
+	__le32 hs_count;
+	struct {
+		struct usb_interface_descriptor intf;
+		struct usb_endpoint_descriptor_no_audio source;
+		struct usb_endpoint_descriptor_no_audio sink;
+	} __attribute__ ((packed)) fs_descs, hs_descs;
+} __attribute__ ((packed)) descriptors = {
+	.header = {
+		.magic = cpu_to_le32(FUNCTIONFS_DESCRIPTORS_MAGIC_V2),
+		.flags = cpu_to_le32(FUNCTIONFS_HAS_FS_DESC |
+				 FUNCTIONFS_HAS_HS_DESC |
+				 FUNCTIONFS_ALL_CTRL_RECIP),
+		.length = cpu_to_le32(sizeof(descriptors)),
+	},
+	.fs_count = cpu_to_le32(3),
+	.hs_count = cpu_to_le32(3),
+	.fs_descs = {
+		.intf = {
+			.bLength = sizeof(descriptors.fs_descs.intf),
+			.bDescriptorType = USB_DT_INTERFACE,
+			.bNumEndpoints = 2,
+			.bInterfaceClass = USB_CLASS_VENDOR_SPEC,
+			.bInterfaceSubClass = USB_SUBCLASS_VENDOR_SPEC,
+			.iInterface = 1,
+		},
+		.source = {
+			.bLength = sizeof(descriptors.fs_descs.source),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = AOA_ACCESSORY_EP_IN,
+			.bmAttributes = USB_ENDPOINT_XFER_BULK,
+			.wMaxPacketSize = cpu_to_le16(64),
+		},
+		.sink = {
+			.bLength = sizeof(descriptors.fs_descs.sink),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = AOA_ACCESSORY_EP_OUT,
+			.bmAttributes = USB_ENDPOINT_XFER_BULK,
+			.wMaxPacketSize = cpu_to_le16(64),
+		},
+	},
+	.hs_descs = {
+		.intf = {
+			.bLength = sizeof(descriptors.hs_descs.intf),
+			.bDescriptorType = USB_DT_INTERFACE,
+			.bNumEndpoints = 2,
+			.bInterfaceClass = USB_CLASS_VENDOR_SPEC,
+			.bInterfaceSubClass = USB_SUBCLASS_VENDOR_SPEC,
+			.iInterface = 1,
+		},
+		.source = {
+			.bLength = sizeof(descriptors.hs_descs.source),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = AOA_ACCESSORY_EP_IN,
+			.bmAttributes = USB_ENDPOINT_XFER_BULK,
+			.wMaxPacketSize = cpu_to_le16(512),
+		},
+		.sink = {
+			.bLength = sizeof(descriptors.hs_descs.sink),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = AOA_ACCESSORY_EP_OUT,
+			.bmAttributes = USB_ENDPOINT_XFER_BULK,
+			.wMaxPacketSize = cpu_to_le16(512),
+		},
+	},
+};
+
+#define EMU_INTERFACE_NAME	"Android Accessory Interface"
+
+static const struct {
+	struct usb_functionfs_strings_head header;
+	struct {
+		__le16 code;
+		const char str1[sizeof(EMU_INTERFACE_NAME)];
+	} __attribute__ ((packed)) lang0;
+} __attribute__ ((packed)) strings = {
+	.header = {
+		.magic = cpu_to_le32(FUNCTIONFS_STRINGS_MAGIC),
+		.length = cpu_to_le32(sizeof(strings)),
+		.str_count = cpu_to_le32(1),
+		.lang_count = cpu_to_le32(1),
+	},
+	.lang0 = {
+		cpu_to_le16(0x0409),
+		EMU_INTERFACE_NAME,
+	},
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_file(const char *dir, const char *name, const char *value)
+{
+	char path[512];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		printf("Unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	ret = write(fd, value, strlen(value));
+	close(fd);
+	if (ret < 0) {
+		printf("Unable to write %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int write_id(const char *name, uint16_t id)
+{
+	char value[16];
+
+	snprintf(value, sizeof(value), "0x%04x", id);
+	return write_file(EMU_GADGET_DIR, name, value);
+}
+
+/* Uses the first UDC, typically dummy_udc.0, unless one is given */
+static const char *find_udc(void)
+{
+	static char name[256];
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir("/sys/class/udc");
+	if (dir == NULL)
+		return NULL;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(name, sizeof(name), "%s", entry->d_name);
+		closedir(dir);
+		return name;
+	}
+
+	closedir(dir);
+	return NULL;
+}
+
+static int gadget_create(emu_t * emu)
+{
+	if (mkdir(EMU_GADGET_DIR, 0755) && (errno != EEXIST)) {
+		printf("Unable to create gadget (is libcomposite loaded?): "
+		       "%s\n", strerror(errno));
+		return -1;
+	}
+
+	if (write_id("idVendor", emu->vid) || write_id("idProduct", emu->pid) ||
+	    write_file(EMU_GADGET_DIR, "bcdUSB", "0x0200"))
+		return -1;
+
+	mkdir(EMU_GADGET_DIR "/strings/0x409", 0755);
+	write_file(EMU_GADGET_DIR "/strings/0x409", "manufacturer",
+		   "Linux ADK");
+	write_file(EMU_GADGET_DIR "/strings/0x409", "product", "AOA emulator");
+	write_file(EMU_GADGET_DIR "/strings/0x409", "serialnumber",
+		   "ADKEMU0001");
+
+	mkdir(EMU_GADGET_DIR "/configs/c.1", 0755);
+	mkdir(EMU_GADGET_DIR "/configs/c.1/strings/0x409", 0755);
+	write_file(EMU_GADGET_DIR "/configs/c.1/strings/0x409",
+		   "configuration", "AOA");
+
+	if (mkdir(EMU_GADGET_DIR "/functions/ffs." EMU_FFS_NAME, 0755) &&
+	    (errno != EEXIST)) {
+		printf("Unable to create FunctionFS function: %s\n",
+		       strerror(errno));
+		return -1;
+	}
+	if (symlink(EMU_GADGET_DIR "/functions/ffs." EMU_FFS_NAME,
+		    EMU_GADGET_DIR "/configs/c.1/ffs." EMU_FFS_NAME) &&
+	    (errno != EEXIST))
+		return -1;
+
+	mkdir(EMU_FFS_DIR, 0755);
+	if (mount(EMU_FFS_NAME, EMU_FFS_DIR, "functionfs", 0, NULL) &&
+	    (errno != EBUSY)) {
+		printf("Unable to mount FunctionFS: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void gadget_destroy(emu_t * emu)
+{
+	if (emu->bound)
+		write_file(EMU_GADGET_DIR, "UDC", "\n");
+	umount(EMU_FFS_DIR);
+	rmdir(EMU_FFS_DIR);
+	unlink(EMU_GADGET_DIR "/configs/c.1/ffs." EMU_FFS_NAME);
+	rmdir(EMU_GADGET_DIR "/configs/c.1/strings/0x409");
+	rmdir(EMU_GADGET_DIR "/configs/c.1");
+	rmdir(EMU_GADGET_DIR "/functions/ffs." EMU_FFS_NAME);
+	rmdir(EMU_GADGET_DIR "/strings/0x409");
+	rmdir(EMU_GADGET_DIR);
+}
+
+static int ffs_open(emu_t * emu)
+{
+	emu->ep0 = open(EMU_FFS_DIR "/ep0", O_RDWR);
+	if (emu->ep0 < 0) {
+		printf("Unable to open ep0: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if ((write(emu->ep0, &descriptors, sizeof(descriptors)) < 0) ||
+	    (write(emu->ep0, &strings, sizeof(strings)) < 0)) {
+		printf("Unable to write FunctionFS descriptors: %s\n",
+		       strerror(errno));
+		return -1;
+	}
+
+	/* ep1 and ep2 follow the order of the endpoint descriptors */
+	emu->ep_in = open(EMU_FFS_DIR "/ep1", O_RDWR);
+	emu->ep_out = open(EMU_FFS_DIR "/ep2", O_RDWR);
+	if ((emu->ep_in < 0) || (emu->ep_out < 0)) {
+		printf("Unable to open bulk endpoints: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Re-enumerates with the given IDs, as a phone switching mode does */
+static int gadget_bind(emu_t * emu, uint16_t vid, uint16_t pid)
+{
+	if (emu->bound) {
+		write_file(EMU_GADGET_DIR, "UDC", "\n");
+		emu->bound = 0;
+	}
+	if (write_id("idVendor", vid) || write_id("idProduct", pid))
+		return -1;
+
+	emu->vid = vid;
+	emu->pid = pid;
+	printf("Enumerating as %4.4x:%4.4x on %s\n", vid, pid, emu->udc);
+	if (write_file(EMU_GADGET_DIR, "UDC", emu->udc))
+		return -1;
+
+	emu->bound = 1;
+	return 0;
+}
+
+/* Sleeps as needed so that bytes transferred since start match rate */
+static void throttle(uint64_t start, uint64_t bytes, uint64_t rate)
+{
+	uint64_t due;
+	struct timespec ts;
+
+	if (!rate)
+		return;
+
+	due = start + bytes * 1000000000ULL / rate;
+	ts.tv_sec = due / 1000000000ULL;
+	ts.tv_nsec = due % 1000000000ULL;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static void *source_loop(void *arg)
+{
+	emu_t *emu = arg;
+	unsigned char *buf;
+	uint64_t start = 0, sent = 0;
+	size_t i;
+
+	/* In echo mode, bulk IN only carries what the sink sends back */
+	if (emu->echo)
+		return NULL;
+
+	buf = malloc(emu->block_size);
+	if (buf == NULL)
+		return NULL;
+	for (i = 0; i < emu->block_size; i++)
+		buf[i] = i;
+	if (emu->integrity)
+		integrity_seal(buf, emu->block_size - INTEGRITY_OVERHEAD);
+
+	while (!stop_emu) {
+		ssize_t ret;
+
+		if (!emu->accessory) {
+			usleep(10000);
+			start = 0;
+			continue;
+		}
+		if (!start) {
+			start = now_ns();
+			sent = 0;
+		}
+
+		ret = write(emu->ep_in, buf, emu->block_size);
+		if (ret < 0) {
+			/* Not enabled by the host yet, or disconnected */
+			usleep(10000);
+			start = 0;
+			continue;
+		}
+
+		sent += ret;
+		emu->tx_bytes += ret;
+		throttle(start, sent, emu->source_rate);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *sink_loop(void *arg)
+{
+	emu_t *emu = arg;
+	unsigned char *buf;
+	uint64_t start = 0, received = 0;
+
+	buf = malloc(EMU_MAX_BLOCK);
+	if (buf == NULL)
+		return NULL;
+
+	while (!stop_emu) {
+		ssize_t ret;
+
+		if (!emu->accessory) {
+			usleep(10000);
+			start = 0;
+			continue;
+		}
+		if (!start) {
+			start = now_ns();
+			received = 0;
+		}
+
+		ret = read(emu->ep_out, buf, EMU_MAX_BLOCK);
+		if (ret < 0) {
+			usleep(10000);
+			start = 0;
+			continue;
+		}
+
+		received += ret;
+		emu->rx_bytes += ret;
+		if (emu->echo) {
+			ssize_t off = 0, n;
+
+			/* linux-adk --ping probes, sent back untouched */
+			while (off < ret) {
+				n = write(emu->ep_in, buf + off, ret - off);
+				if (n < 0)
+					break;
+				off += n;
+			}
+			/*
+			 * The host read only ends on a short packet: terminate
+			 * writes of whole packets with a zero length one.
+			 */
+			if ((off == ret) && !(ret % emu->ep_in_packet))
+				n = write(emu->ep_in, buf, 0);
+			emu->tx_bytes += off;
+		}
+		throttle(start, received, emu->sink_rate);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *stats_loop(void *arg)
+{
+	emu_t *emu = arg;
+	uint64_t tx = 0, rx = 0, hid = 0;
+
+	while (!stop_emu) {
+		sleep(1);
+		if (!emu->accessory)
+			continue;
+
+		printf("TX %8.2f MB/s  RX %8.2f MB/s  HID %6llu events/s\n",
+		       (emu->tx_bytes - tx) / 1e6, (emu->rx_bytes - rx) / 1e6,
+		       (unsigned long long)(emu->hid_events - hid));
+		tx = emu->tx_bytes;
+		rx = emu->rx_bytes;
+		hid = emu->hid_events;
+	}
+
+	return NULL;
+}
+
+static emu_hid *find_hid(emu_t * emu, uint16_t id, int create)
+{
+	int i;
+
+	for (i = 0; i < EMU_HID_MAX; i++)
+		if (emu->hid[i].registered && (emu->hid[i].id == id))
+			return &emu->hid[i];
+
+	if (!create)
+		return NULL;
+
+	for (i = 0; i < EMU_HID_MAX; i++)
+		if (!emu->hid[i].registered) {
+			memset(&emu->hid[i], 0, sizeof(emu->hid[i]));
+			emu->hid[i].id = id;
+			emu->hid[i].registered = 1;
+			return &emu->hid[i];
+		}
+
+	return NULL;
+}
+
+/* Acks a request without data stage or reads its data stage */
+static int ep0_read(emu_t * emu, void *buf, size_t len)
+{
+	return read(emu->ep0, buf, len);
+}
+
+/* Stalls by doing the data stage in the wrong direction */
+static void ep0_stall(emu_t * emu, const struct usb_ctrlrequest *setup)
+{
+	char c;
+
+	if (setup->bRequestType & USB_DIR_IN)
+		(void)!read(emu->ep0, &c, 0);
+	else
+		(void)!write(emu->ep0, &c, 0);
+}
+
+static void handle_setup(emu_t * emu, const struct usb_ctrlrequest *setup)
+{
+	uint16_t value = le16toh(setup->wValue);
+	uint16_t index = le16toh(setup->wIndex);
+	uint16_t length = le16toh(setup->wLength);
+	unsigned char data[4096];
+	emu_hid *hid;
+	int ret;
+
+	if ((setup->bRequestType & USB_TYPE_MASK) != USB_TYPE_VENDOR) {
+		ep0_stall(emu, setup);
+		return;
+	}
+
+	switch (setup->bRequest) {
+	case AOA_GET_PROTOCOL:
+		data[0] = 2;
+		data[1] = 0;
+		if (write(emu->ep0, data, length < 2 ? length : 2) < 0)
+			printf("Unable to answer AOA_GET_PROTOCOL\n");
+		break;
+	case AOA_SEND_IDENT:
+		ret = ep0_read(emu, data, length < sizeof(data) ?
+			       length : sizeof(data));
+		if ((ret > 0) && (index <= AOA_STRING_SER_ID)) {
+			snprintf(emu->ident[index], sizeof(emu->ident[index]),
+				 "%.*s", ret, data);
+			printf(" identification %u: %s\n", index,
+			       emu->ident[index]);
+		}
+		break;
+	case AOA_START_ACCESSORY:
+		ep0_read(emu, NULL, 0);
+		printf("Starting accessory mode\n");
+		/* Let the host see the status stage before disconnecting */
+		usleep(10000);
+		gadget_bind(emu, AOA_ACCESSORY_VID, AOA_ACCESSORY_PID);
+		break;
+	case AOA_AUDIO_SUPPORT:
+		ep0_read(emu, NULL, 0);
+		break;
+	case AOA_REGISTER_HID:
+		ep0_read(emu, NULL, 0);
+		hid = find_hid(emu, value, 1);
+		if (hid) {
+			hid->descriptor_size = index;
+			printf("HID %u registered (%u bytes descriptor)\n",
+			       value, index);
+		}
+		break;
+	case AOA_UNREGISTER_HID:
+		ep0_read(emu, NULL, 0);
+		hid = find_hid(emu, value, 0);
+		if (hid) {
+			printf("HID %u unregistered: %llu events\n", value,
+			       (unsigned long long)hid->events);
+			hid->registered = 0;
+		}
+		break;
+	case AOA_SET_HID_REPORT_DESC:
+		ret = ep0_read(emu, data, length < sizeof(data) ?
+			       length : sizeof(data));
+		hid = find_hid(emu, value, 0);
+		if (hid && (ret > 0))
+			hid->descriptor_len = index + ret;
+		break;
+	case AOA_SEND_HID_EVENT:
+		ret = ep0_read(emu, data, length < sizeof(data) ?
+			       length : sizeof(data));
+		hid = find_hid(emu, value, 0);
+		if (hid && (ret > 0)) {
+			hid->events++;
+			hid->event_bytes += ret;
+			emu->hid_events++;
+			if (emu->verbose) {
+				int i;
+
+				printf("HID %u event:", value);
+				for (i = 0; i < ret; i++)
+					printf(" %02x", data[i]);
+				printf("\n");
+			}
+		}
+		break;
+	default:
+		ep0_stall(emu, setup);
+		break;
+	}
+}
+
+/* Packet size of bulk IN at the speed the function was enabled at */
+static int ep_in_packet_size(emu_t * emu)
+{
+	struct usb_endpoint_descriptor desc;
+
+	if (ioctl(emu->ep_in, FUNCTIONFS_ENDPOINT_DESC, &desc) < 0) {
+		printf("Unable to get the bulk IN descriptor: %s\n",
+		       strerror(errno));
+		/* Smallest packet size, may send spurious zero length packets */
+		return 64;
+	}
+
+	return le16toh(desc.wMaxPacketSize) & 0x7ff;
+}
+
+static void ep0_loop(emu_t * emu)
+{
+	struct usb_functionfs_event events[4];
+
+	while (!stop_emu) {
+		ssize_t ret;
+		int i, n;
+
+		ret = read(emu->ep0, events, sizeof(events));
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("ep0 read failed: %s\n", strerror(errno));
+			break;
+		}
+
+		n = ret / sizeof(events[0]);
+		for (i = 0; i < n; i++) {
+			switch (events[i].type) {
+			case FUNCTIONFS_ENABLE:
+				emu->ep_in_packet = ep_in_packet_size(emu);
+				emu->accessory = (emu->vid == AOA_ACCESSORY_VID)
+				    && (emu->pid >= AOA_ACCESSORY_PID);
+				printf("Function enabled (%d byte packets)%s\n",
+				       emu->ep_in_packet, emu->accessory ?
+				       ", accessory mode" : "");
+				break;
+			case FUNCTIONFS_DISABLE:
+				emu->accessory = 0;
+				break;
+			case FUNCTIONFS_SETUP:
+				handle_setup(emu, &events[i].u.setup);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+/* Parses a size with an optional k/M/G suffix */
+static uint64_t parse_size(const char *arg)
+{
+	char *end;
+	uint64_t value = strtoull(arg, &end, 10);
+
+	switch (*end) {
+	case 'G':
+	case 'g':
+		value *= 1024;
+		/* fall through */
+	case 'M':
+	case 'm':
+		value *= 1024;
+		/* fall through */
+	case 'K':
+	case 'k':
+		value *= 1024;
+		break;
+	}
+
+	return value;
+}
+
+static void show_help(char *name)
+{
+	printf("Linux ADK - AOA phone emulator\n\nusage: %s [OPTIONS]\n"
+	       "OPTIONS:\n"
+	       "\t-b, --block-size\n\t\tsize of the bulk IN writes. "
+	       "Default is %d.\n"
+	       "\t-C, --integrity\n\t\tframe the bulk IN data with "
+	       "CRC-32C.\n"
+	       "\t-d, --device\n\t\tUSB device product and vendor IDs before "
+	       "switching to accessory mode. Default is \"%s\".\n"
+	       "\t-e, --echo\n\t\twrite the bulk OUT data back on bulk "
+	       "IN, as expected by linux-adk --ping, instead of sourcing "
+	       "data.\n"
+	       "\t-i, --sink-rate\n\t\tmaximum rate at which bulk OUT data is "
+	       "consumed, in bytes/s (k/M/G suffixes allowed). "
+	       "Default is unlimited.\n"
+	       "\t-o, --source-rate\n\t\trate at which bulk IN data is "
+	       "produced, in bytes/s (k/M/G suffixes allowed). "
+	       "Default is unlimited.\n"
+	       "\t-u, --udc\n\t\tUSB device controller to bind to. "
+	       "Default is the first one, e.g. dummy_udc.0.\n"
+	       "\t-V, --verbose\n\t\tdisplay every HID event.\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", name,
+	       EMU_DEFAULT_BLOCK, EMU_DEFAULT_DEVICE);
+}
+
+static void signal_handler(int signo)
+{
+	stop_emu = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = EMU_DEFAULT_DEVICE;
+	pthread_t source, sink, stats;
+	struct sigaction sa;
+	int arg_count = 1;
+	char *tmp;
+	emu_t emu;
+
+	memset(&emu, 0, sizeof(emu));
+	emu.block_size = EMU_DEFAULT_BLOCK;
+	emu.ep0 = emu.ep_in = emu.ep_out = -1;
+	emu.ep_in_packet = 64;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-b") == 0)
+		    || (strcmp(argv[arg_count], "--block-size") == 0)) {
+			emu.block_size = parse_size(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-C") == 0)
+			   || (strcmp(argv[arg_count], "--integrity") == 0)) {
+			emu.integrity = 1;
+		} else if ((strcmp(argv[arg_count], "-d") == 0)
+			   || (strcmp(argv[arg_count], "--device") == 0)) {
+			device = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-e") == 0)
+			   || (strcmp(argv[arg_count], "--echo") == 0)) {
+			emu.echo = 1;
+		} else if ((strcmp(argv[arg_count], "-i") == 0)
+			   || (strcmp(argv[arg_count], "--sink-rate") == 0)) {
+			emu.sink_rate = parse_size(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-o") == 0)
+			   || (strcmp(argv[arg_count], "--source-rate") == 0)) {
+			emu.source_rate = parse_size(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-u") == 0)
+			   || (strcmp(argv[arg_count], "--udc") == 0)) {
+			emu.udc = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-V") == 0)
+			   || (strcmp(argv[arg_count], "--verbose") == 0)) {
+			emu.verbose = 1;
+		} else {
+			show_help(argv[0]);
+			exit(1);
+		}
+		arg_count++;
+	}
+
+	if (!emu.block_size || (emu.block_size > EMU_MAX_BLOCK)) {
+		printf("Block size must be between 1 and %d\n", EMU_MAX_BLOCK);
+		return 1;
+	}
+	if (emu.integrity && (emu.block_size <= INTEGRITY_OVERHEAD)) {
+		printf("Block size must be above %d with integrity framing\n",
+		       INTEGRITY_OVERHEAD);
+		return 1;
+	}
+
+	emu.vid = (uint16_t) strtol(device, &tmp, 16);
+	emu.pid = (uint16_t) strtol(tmp + 1, &tmp, 16);
+
+	if (!emu.udc)
+		emu.udc = find_udc();
+	if (!emu.udc) {
+		printf("No USB device controller (modprobe dummy_hcd?)\n");
+		return 1;
+	}
+
+	/* No SA_RESTART so that blocking reads get interrupted */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = signal_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	setbuf(stdout, NULL);
+
+	if (gadget_create(&emu) || ffs_open(&emu) ||
+	    gadget_bind(&emu, emu.vid, emu.pid))
+		goto end;
+
+	pthread_create(&source, NULL, source_loop, &emu);
+	pthread_create(&sink, NULL, sink_loop, &emu);
+	pthread_create(&stats, NULL, stats_loop, &emu);
+
+	ep0_loop(&emu);
+
+	/* Unbinding fails the pending endpoint I/O */
+	stop_emu = 1;
+	write_file(EMU_GADGET_DIR, "UDC", "\n");
+	emu.bound = 0;
+	pthread_join(source, NULL);
+	pthread_join(sink, NULL);
+	pthread_join(stats, NULL);
+
+	printf("Sent %llu bytes, received %llu bytes, %llu HID events\n",
+	       (unsigned long long)emu.tx_bytes,
+	       (unsigned long long)emu.rx_bytes,
+	       (unsigned long long)emu.hid_events);
+end:
+	if (emu.ep_in >= 0)
+		close(emu.ep_in);
+	if (emu.ep_out >= 0)
+		close(emu.ep_out);
+	if (emu.ep0 >= 0)
+		close(emu.ep0);
+	gadget_destroy(&emu);
+	return 0;
+}
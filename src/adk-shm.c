@@ -0,0 +1,142 @@
+/*
+ * Linux ADK - adk-shm.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Reader of the shared memory ring published by linux-adk --shm-ring:
+ * shows the rate of records and the overruns, or writes the data out.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shmring.h"
+
+static volatile int stop_reader = 0;
+
+static void show_help(char *name)
+{
+	printf("Linux ADK shared memory ring reader\n\nusage: %s [OPTIONS] "
+	       "[NAME]\nNAME defaults to \"%s\".\nOPTIONS:\n"
+	       "\t-r, --raw\n\t\twrite the data to stdout, statistics going "
+	       "to stderr.\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", name,
+	       SHMRING_DEFAULT_NAME);
+}
+
+static void signal_handler(int signo)
+{
+	stop_reader = 1;
+}
+
+static void print_stats(FILE *out, shmring_reader *reader, double elapsed,
+			uint64_t records, uint64_t bytes)
+{
+	fprintf(out, "%8llu records/s %8.2f MB/s  overruns %llu, "
+		"%llu records lost\n",
+		(unsigned long long)((reader->records - records) / elapsed),
+		(reader->bytes - bytes) / elapsed / 1e6,
+		(unsigned long long)reader->overruns,
+		(unsigned long long)reader->lost);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = SHMRING_DEFAULT_NAME;
+	uint64_t records = 0, bytes = 0;
+	shmring_reader reader;
+	unsigned char *copy = NULL;
+	size_t copy_size = 0;
+	int arg_count = 1;
+	int raw = 0;
+	time_t last;
+	FILE *out;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-r") == 0)
+		    || (strcmp(argv[arg_count], "--raw") == 0)) {
+			raw = 1;
+		} else if (argv[arg_count][0] == '-') {
+			show_help(argv[0]);
+			exit(1);
+		} else {
+			name = argv[arg_count];
+		}
+		arg_count++;
+	}
+
+	if (shmring_open(&reader, name) < 0) {
+		printf("Unable to open shared memory ring %s\n", name);
+		return 1;
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	out = raw ? stderr : stdout;
+	last = time(NULL);
+
+	while (!stop_reader) {
+		const void *data;
+		uint64_t seq;
+		size_t len;
+
+		data = shmring_peek(&reader, &len, &seq);
+		if (data == NULL) {
+			if (shmring_wait(&reader, 100) < 0)
+				break;
+		} else {
+			/* Copied out, only written once checked as intact */
+			if (raw && (len > copy_size)) {
+				free(copy);
+				copy = malloc(len);
+				copy_size = copy ? len : 0;
+				if (copy == NULL)
+					break;
+			}
+			if (raw)
+				memcpy(copy, data, len);
+			if (shmring_next(&reader) < 0)
+				fprintf(out, "record %llu overwritten while "
+					"being read\n", (unsigned long long)seq);
+			else if (raw && (fwrite(copy, 1, len, stdout) != len))
+				break;
+		}
+
+		if (time(NULL) != last) {
+			print_stats(out, &reader, time(NULL) - last, records,
+				    bytes);
+			last = time(NULL);
+			records = reader.records;
+			bytes = reader.bytes;
+		}
+	}
+
+	fprintf(out, "Read %llu records (%llu bytes), %llu overruns, "
+		"%llu records lost\n", (unsigned long long)reader.records,
+		(unsigned long long)reader.bytes,
+		(unsigned long long)reader.overruns,
+		(unsigned long long)reader.lost);
+	shmring_close(&reader);
+	free(copy);
+	return 0;
+}
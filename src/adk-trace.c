@@ -0,0 +1,191 @@
+/*
+ * Linux ADK - adk-trace.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+typedef struct {
+	uint32_t tid;
+	trace_record rec;
+} trace_entry;
+
+typedef struct {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t bytes;
+} trace_stat;
+
+static const char *event_names[] = {
+	[TRACE_SUBMIT] = "SUBMIT",
+	[TRACE_COMPLETE] = "COMPLETE",
+	[TRACE_ERROR] = "ERROR",
+	[TRACE_WAKEUP] = "WAKEUP",
+	[TRACE_DROP] = "DROP",
+};
+
+#define EVENT_COUNT	(sizeof(event_names) / sizeof(event_names[0]))
+
+static const char *event_name(uint16_t event)
+{
+	if ((event < EVENT_COUNT) && event_names[event])
+		return event_names[event];
+	return "UNKNOWN";
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const trace_entry *ea = a, *eb = b;
+
+	if (ea->rec.ts != eb->rec.ts)
+		return ea->rec.ts < eb->rec.ts ? -1 : 1;
+	return 0;
+}
+
+static void show_help(char *name)
+{
+	printf("Linux ADK trace decoder\n\nusage: %s [OPTIONS] [FILE]\n"
+	       "FILE defaults to \"%s\".\nOPTIONS:\n"
+	       "\t-s, --summary\n\t\tonly show per event statistics.\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", name,
+	       TRACE_DEFAULT_FILE);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = TRACE_DEFAULT_FILE;
+	trace_stat stats[EVENT_COUNT][256];
+	trace_dump_header hdr;
+	trace_entry *entries = NULL;
+	size_t count = 0, i;
+	int summary = 0;
+	int arg_count = 1;
+	uint32_t r;
+	FILE *f;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-s") == 0)
+		    || (strcmp(argv[arg_count], "--summary") == 0)) {
+			summary = 1;
+		} else if (argv[arg_count][0] == '-') {
+			show_help(argv[0]);
+			exit(1);
+		} else {
+			path = argv[arg_count];
+		}
+		arg_count++;
+	}
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		printf("Unable to open %s\n", path);
+		return 1;
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    (hdr.version != TRACE_VERSION) ||
+	    (hdr.record_size != sizeof(trace_record))) {
+		printf("%s: not a trace file\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	for (r = 0; r < hdr.ring_count; r++) {
+		trace_dump_ring rhdr;
+		trace_entry *tmp;
+		uint32_t j;
+
+		if (fread(&rhdr, sizeof(rhdr), 1, f) != 1)
+			goto truncated;
+
+		printf("thread %u: %u records", rhdr.tid, rhdr.count);
+		if (rhdr.lost)
+			printf(" (%llu older records overwritten)",
+			       (unsigned long long)rhdr.lost);
+		printf("\n");
+
+		tmp = realloc(entries, (count + rhdr.count) * sizeof(*entries));
+		if (tmp == NULL)
+			goto truncated;
+		entries = tmp;
+
+		for (j = 0; j < rhdr.count; j++, count++) {
+			entries[count].tid = rhdr.tid;
+			if (fread(&entries[count].rec, sizeof(trace_record), 1,
+				  f) != 1)
+				goto truncated;
+		}
+	}
+	fclose(f);
+
+	qsort(entries, count, sizeof(*entries), compare_entries);
+	memset(stats, 0, sizeof(stats));
+
+	for (i = 0; i < count; i++) {
+		trace_record *rec = &entries[i].rec;
+		trace_stat *st;
+
+		if (!summary)
+			printf("%14.6f %6u %-8s ep 0x%02x status %4d len %6u "
+			       "arg %u\n",
+			       (rec->ts - entries[0].rec.ts) / 1e9,
+			       entries[i].tid, event_name(rec->event),
+			       rec->endpoint, rec->status, rec->length,
+			       rec->arg);
+
+		if (rec->event >= EVENT_COUNT)
+			continue;
+		st = &stats[rec->event][rec->endpoint];
+		st->count++;
+		st->bytes += rec->length;
+		if (rec->status)
+			st->errors++;
+	}
+
+	printf("\n%-8s %-6s %10s %10s %14s\n", "event", "ep", "count",
+	       "errors", "bytes");
+	for (r = 0; r < EVENT_COUNT; r++) {
+		int ep;
+
+		for (ep = 0; ep < 256; ep++) {
+			trace_stat *st = &stats[r][ep];
+
+			if (!st->count)
+				continue;
+			printf("%-8s 0x%02x   %10llu %10llu %14llu\n",
+			       event_name(r), ep,
+			       (unsigned long long)st->count,
+			       (unsigned long long)st->errors,
+			       (unsigned long long)st->bytes);
+		}
+	}
+
+	free(entries);
+	return 0;
+
+truncated:
+	printf("%s: truncated trace file\n", path);
+	fclose(f);
+	free(entries);
+	return 1;
+}
@@ -0,0 +1,514 @@
+/*
+ * Linux ADK - adk.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <libusb.h>
+
+#include "adk.h"
+#include "trace.h"
+
+#ifdef WIN32
+#define sleep(x) Sleep(x * 1000)
+#define usleep(x) Sleep(x / 1000)
+#endif
+
+struct adk_ctx {
+	struct libusb_device_handle *handle;
+	char *strings[AOA_STRING_COUNT];
+	int aoa_version;
+	uint16_t vid;
+	uint16_t pid;
+	int claimed;
+};
+
+/* Bookkeeping of an asynchronous request, freed on completion */
+struct adk_request {
+	adk_ctx *ctx;
+	adk_callback callback;
+	void *user_data;
+};
+
+/* Every product ID of a device in accessory mode */
+static const uint16_t accessory_pids[] = {
+	AOA_ACCESSORY_PID,
+	AOA_ACCESSORY_ADB_PID,
+	AOA_AUDIO_PID,
+	AOA_AUDIO_ADB_PID,
+	AOA_ACCESSORY_AUDIO_PID,
+	AOA_ACCESSORY_AUDIO_ADB_PID,
+};
+
+adk_ctx *adk_new(int verbose)
+{
+	adk_ctx *ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+
+	if (libusb_init(NULL) != 0) {
+		free(ctx);
+		return NULL;
+	}
+	if (verbose)
+		libusb_set_option(NULL, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
+
+	return ctx;
+}
+
+int adk_set_string(adk_ctx * ctx, int id, const char *value)
+{
+	char *copy = NULL;
+
+	if ((id < 0) || (id >= AOA_STRING_COUNT))
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	if (value) {
+		copy = strdup(value);
+		if (copy == NULL)
+			return LIBUSB_ERROR_NO_MEM;
+	}
+
+	free(ctx->strings[id]);
+	ctx->strings[id] = copy;
+	return 0;
+}
+
+static int open_accessory(adk_ctx * ctx)
+{
+	unsigned int i;
+
+	/* Trying to open all the AOA IDs possible */
+	for (i = 0; i < sizeof(accessory_pids) / sizeof(accessory_pids[0]);
+	     i++) {
+		ctx->handle = libusb_open_device_with_vid_pid(NULL,
+							      AOA_ACCESSORY_VID,
+							      accessory_pids[i]);
+		if (ctx->handle != NULL) {
+			ctx->vid = AOA_ACCESSORY_VID;
+			ctx->pid = accessory_pids[i];
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int adk_init(adk_ctx * ctx, uint16_t vid, uint16_t pid, int aoa_max_version)
+{
+	struct libusb_device_handle *handle;
+	uint8_t buffer[2];
+	int tries = 10;
+	int ret, i;
+
+	/* Check if device is not already in accessory mode */
+	if (open_accessory(ctx))
+		return 0;
+
+	/* Trying to open it */
+	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
+	if (handle == NULL)
+		return LIBUSB_ERROR_NOT_FOUND;
+
+	/* Now asking if device supports Android Open Accessory protocol */
+	ret = libusb_control_transfer(handle,
+				      LIBUSB_ENDPOINT_IN |
+				      LIBUSB_REQUEST_TYPE_VENDOR,
+				      AOA_GET_PROTOCOL, 0, 0, buffer,
+				      sizeof(buffer), 0);
+	if (ret < 0)
+		goto error;
+	ctx->aoa_version = ((buffer[1] << 8) | buffer[0]);
+	if ((ret < (int)sizeof(buffer)) || !ctx->aoa_version) {
+		ret = ADK_ERROR_NO_AOA;
+		goto error;
+	}
+	if ((aoa_max_version > 0) && (ctx->aoa_version > aoa_max_version))
+		ctx->aoa_version = aoa_max_version;
+
+	/* Some Android devices require a waiting period between transfer calls */
+	usleep(10000);
+
+	/* In case of a no_app accessory, the version must be >= 2 */
+	if ((ctx->aoa_version < 2) && !ctx->strings[AOA_STRING_MAN_ID]) {
+		ret = ADK_ERROR_NEED_AOA2;
+		goto error;
+	}
+
+	/* Sending identification to the device */
+	for (i = 0; i < AOA_STRING_COUNT; i++) {
+		if (ctx->strings[i] == NULL)
+			continue;
+		ret = libusb_control_transfer(handle,
+					      LIBUSB_ENDPOINT_OUT
+					      | LIBUSB_REQUEST_TYPE_VENDOR,
+					      AOA_SEND_IDENT, 0, i,
+					      (uint8_t *) ctx->strings[i],
+					      strlen(ctx->strings[i]) + 1, 0);
+		if (ret < 0)
+			goto error;
+	}
+
+	if (ctx->aoa_version >= 2) {
+		/* Asking for audio support */
+		ret = libusb_control_transfer(handle,
+					      LIBUSB_ENDPOINT_OUT
+					      | LIBUSB_REQUEST_TYPE_VENDOR,
+					      AOA_AUDIO_SUPPORT, 1, 0, 0, 0, 0);
+		if (ret < 0)
+			goto error;
+	}
+
+	/* Turning the device in Accessory mode */
+	ret = libusb_control_transfer(handle,
+				      LIBUSB_ENDPOINT_OUT |
+				      LIBUSB_REQUEST_TYPE_VENDOR,
+				      AOA_START_ACCESSORY, 0, 0, NULL, 0, 0);
+	if (ret < 0)
+		goto error;
+	libusb_close(handle);
+
+	/* Let some time for the new enumeration to happen */
+	usleep(10000);
+
+	/* Connect to the Accessory */
+	while (tries--) {
+		if (open_accessory(ctx))
+			return 0;
+		if (tries)
+			sleep(1);
+	}
+
+	return LIBUSB_ERROR_NO_DEVICE;
+
+error:
+	libusb_close(handle);
+	return ret;
+}
+
+void adk_exit(adk_ctx * ctx)
+{
+	int i;
+
+	if (ctx->handle != NULL) {
+		if (ctx->claimed)
+			libusb_release_interface(ctx->handle,
+						 AOA_ACCESSORY_INTERFACE);
+		libusb_close(ctx->handle);
+	}
+
+	libusb_exit(NULL);
+
+	for (i = 0; i < AOA_STRING_COUNT; i++)
+		free(ctx->strings[i]);
+	free(ctx);
+}
+
+int adk_claim(adk_ctx * ctx)
+{
+	int ret;
+
+	ret = libusb_claim_interface(ctx->handle, AOA_ACCESSORY_INTERFACE);
+	if (ret == 0)
+		ctx->claimed = 1;
+
+	return ret;
+}
+
+const char *adk_strerror(int err)
+{
+	switch (err) {
+	case ADK_ERROR_NO_AOA:
+		return "ADK_ERROR_NO_AOA";
+	case ADK_ERROR_NEED_AOA2:
+		return "ADK_ERROR_NEED_AOA2";
+	default:
+		return libusb_error_name(err);
+	}
+}
+
+uint16_t adk_get_vid(const adk_ctx * ctx)
+{
+	return ctx->vid;
+}
+
+uint16_t adk_get_pid(const adk_ctx * ctx)
+{
+	return ctx->pid;
+}
+
+/* 0 when the device was already in accessory mode */
+int adk_get_aoa_version(const adk_ctx * ctx)
+{
+	return ctx->aoa_version;
+}
+
+/* USB serial number of the device, vid:pid when it has none */
+int adk_get_serial(adk_ctx * ctx, char *buf, int len)
+{
+	struct libusb_device_descriptor desc;
+	int ret;
+
+	ret = libusb_get_device_descriptor(libusb_get_device(ctx->handle),
+					   &desc);
+	if ((ret == 0) && desc.iSerialNumber) {
+		ret = libusb_get_string_descriptor_ascii(ctx->handle,
+							 desc.iSerialNumber,
+							 (unsigned char *)buf,
+							 len);
+		if (ret > 0)
+			return 0;
+	}
+
+	snprintf(buf, len, "%4.4x:%4.4x", ctx->vid, ctx->pid);
+	return ret < 0 ? ret : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int adk_read(adk_ctx * ctx, unsigned char *buf, int len, int *transferred,
+	     unsigned int timeout)
+{
+	int ret;
+
+	*transferred = 0;
+	trace(TRACE_SUBMIT, AOA_ACCESSORY_EP_IN, 0, len, 0);
+	ret = libusb_bulk_transfer(ctx->handle, AOA_ACCESSORY_EP_IN, buf, len,
+				   transferred, timeout);
+	if (ret < 0)
+		trace(TRACE_ERROR, AOA_ACCESSORY_EP_IN, ret, *transferred, 0);
+	else
+		trace(TRACE_COMPLETE, AOA_ACCESSORY_EP_IN, 0, *transferred, 0);
+
+	return ret;
+}
+
+static int transfer_status(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return LIBUSB_ERROR_INTERRUPTED;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return LIBUSB_ERROR_OVERFLOW;
+	default:
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+static void callback_request(struct libusb_transfer *transfer)
+{
+	struct adk_request *req = transfer->user_data;
+	unsigned char *buf = transfer->buffer;
+
+	if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+		buf += LIBUSB_CONTROL_SETUP_SIZE;
+
+	trace(TRACE_COMPLETE, transfer->endpoint, transfer->status,
+	      transfer->actual_length, 0);
+
+	if (req->callback)
+		req->callback(req->ctx, transfer_status(transfer->status), buf,
+			      transfer->actual_length, req->user_data);
+
+	/* The request also holds the buffer of control transfers */
+	free(req);
+	libusb_free_transfer(transfer);
+}
+
+static int submit_bulk(adk_ctx * ctx, unsigned char endpoint,
+		       unsigned char *buf, int len, unsigned int timeout,
+		       unsigned int flags, adk_callback callback,
+		       void *user_data)
+{
+	struct libusb_transfer *transfer;
+	struct adk_request *req;
+	int ret;
+
+	transfer = libusb_alloc_transfer(0);
+	req = malloc(sizeof(*req));
+	if ((transfer == NULL) || (req == NULL)) {
+		libusb_free_transfer(transfer);
+		free(req);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	req->ctx = ctx;
+	req->callback = callback;
+	req->user_data = user_data;
+	libusb_fill_bulk_transfer(transfer, ctx->handle, endpoint, buf, len,
+				  callback_request, req, timeout);
+	if (flags & ADK_WRITE_ZLP)
+		transfer->flags |= LIBUSB_TRANSFER_ADD_ZERO_PACKET;
+
+	ret = libusb_submit_transfer(transfer);
+	if (ret) {
+		trace(TRACE_ERROR, endpoint, ret, len, 0);
+		free(req);
+		libusb_free_transfer(transfer);
+	} else {
+		trace(TRACE_SUBMIT, endpoint, 0, len, 0);
+	}
+
+	return ret;
+}
+
+int adk_submit_read(adk_ctx * ctx, unsigned char *buf, int len,
+		    unsigned int timeout, adk_callback callback,
+		    void *user_data)
+{
+	return submit_bulk(ctx, AOA_ACCESSORY_EP_IN, buf, len, timeout, 0,
+			   callback, user_data);
+}
+
+int adk_submit_write(adk_ctx * ctx, unsigned char *buf, int len,
+		     unsigned int timeout, unsigned int flags,
+		     adk_callback callback, void *user_data)
+{
+	return submit_bulk(ctx, AOA_ACCESSORY_EP_OUT, buf, len, timeout,
+			   flags, callback, user_data);
+}
+
+int adk_handle_events(adk_ctx * ctx, int timeout_ms)
+{
+	struct timeval tv;
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+}
+
+int adk_get_pollfds(adk_ctx * ctx, adk_pollfd * fds, int max)
+{
+	const struct libusb_pollfd **list;
+	int n;
+
+	list = libusb_get_pollfds(NULL);
+	if (list == NULL)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	for (n = 0; (n < max) && list[n]; n++) {
+		fds[n].fd = list[n]->fd;
+		fds[n].events = list[n]->events;
+	}
+	libusb_free_pollfds(list);
+
+	return n;
+}
+
+int adk_get_next_timeout(adk_ctx * ctx, int *timeout_ms)
+{
+	struct timeval tv;
+	int ret;
+
+	ret = libusb_get_next_timeout(NULL, &tv);
+	if (ret == 1)
+		*timeout_ms = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+	else
+		*timeout_ms = -1;
+
+	return ret < 0 ? ret : 0;
+}
+
+int adk_hid_register(adk_ctx * ctx, uint16_t id,
+		     const unsigned char *descriptor, int size)
+{
+	int ret;
+
+	ret = libusb_control_transfer(ctx->handle, LIBUSB_ENDPOINT_OUT |
+				      LIBUSB_REQUEST_TYPE_VENDOR,
+				      AOA_REGISTER_HID, id, size, NULL, 0, 0);
+	if (ret < 0)
+		return ret;
+
+	ret = libusb_control_transfer(ctx->handle, LIBUSB_ENDPOINT_OUT |
+				      LIBUSB_REQUEST_TYPE_VENDOR,
+				      AOA_SET_HID_REPORT_DESC, id, 0,
+				      (unsigned char *)descriptor, size, 0);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
+int adk_hid_unregister(adk_ctx * ctx, uint16_t id)
+{
+	int ret;
+
+	ret = libusb_control_transfer(ctx->handle, LIBUSB_ENDPOINT_OUT |
+				      LIBUSB_REQUEST_TYPE_VENDOR,
+				      AOA_UNREGISTER_HID, id, 0, NULL, 0, 0);
+
+	return ret < 0 ? ret : 0;
+}
+
+int adk_hid_send(adk_ctx * ctx, uint16_t id,
+		 const unsigned char *report, int len, unsigned int timeout,
+		 adk_callback callback, void *user_data)
+{
+	struct libusb_transfer *transfer;
+	struct adk_request *req;
+	unsigned char *buf;
+	int ret;
+
+	/* Request, control setup and report share a single allocation */
+	transfer = libusb_alloc_transfer(0);
+	req = malloc(sizeof(*req) + LIBUSB_CONTROL_SETUP_SIZE + len);
+	if ((transfer == NULL) || (req == NULL)) {
+		libusb_free_transfer(transfer);
+		free(req);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	req->ctx = ctx;
+	req->callback = callback;
+	req->user_data = user_data;
+
+	buf = (unsigned char *)(req + 1);
+	memcpy(buf + LIBUSB_CONTROL_SETUP_SIZE, report, len);
+	libusb_fill_control_setup(buf, LIBUSB_ENDPOINT_OUT |
+				  LIBUSB_REQUEST_TYPE_VENDOR,
+				  AOA_SEND_HID_EVENT, id, 0, len);
+	libusb_fill_control_transfer(transfer, ctx->handle, buf,
+				     callback_request, req, timeout);
+
+	ret = libusb_submit_transfer(transfer);
+	if (ret) {
+		trace(TRACE_ERROR, 0, ret, len, id);
+		free(req);
+		libusb_free_transfer(transfer);
+	} else {
+		trace(TRACE_SUBMIT, 0, 0, len, id);
+	}
+
+	return ret;
+}
@@ -0,0 +1,159 @@
+/*
+ * Linux ADK - adk.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _ADK_H_
+#define _ADK_H_
+
+#include <stdint.h>
+
+/* Android Open Accessory protocol defines */
+#define AOA_GET_PROTOCOL		51
+#define AOA_SEND_IDENT			52
+#define AOA_START_ACCESSORY		53
+#define AOA_REGISTER_HID		54
+#define AOA_UNREGISTER_HID		55
+#define AOA_SET_HID_REPORT_DESC		56
+#define AOA_SEND_HID_EVENT		57
+#define AOA_AUDIO_SUPPORT		58
+
+/* String IDs */
+#define AOA_STRING_MAN_ID		0
+#define AOA_STRING_MOD_ID		1
+#define AOA_STRING_DSC_ID		2
+#define AOA_STRING_VER_ID		3
+#define AOA_STRING_URL_ID		4
+#define AOA_STRING_SER_ID		5
+#define AOA_STRING_COUNT		6
+
+/* Product IDs / Vendor IDs */
+#define AOA_ACCESSORY_VID		0x18D1	/* Google */
+#define AOA_ACCESSORY_PID		0x2D00	/* accessory */
+#define AOA_ACCESSORY_ADB_PID		0x2D01	/* accessory + adb */
+#define AOA_AUDIO_PID			0x2D02	/* audio */
+#define AOA_AUDIO_ADB_PID		0x2D03	/* audio + adb */
+#define AOA_ACCESSORY_AUDIO_PID		0x2D04	/* accessory + audio */
+#define AOA_ACCESSORY_AUDIO_ADB_PID	0x2D05	/* accessory + audio + adb */
+
+/* Endpoint Addresses TODO get from interface descriptor */
+#define AOA_ACCESSORY_EP_IN		0x81
+#define AOA_ACCESSORY_EP_OUT		0x02
+#define AOA_ACCESSORY_INTERFACE		0x00
+
+/* Only the functions below are exported by libadk.so */
+#if defined(__GNUC__) && !defined(WIN32)
+#define ADK_EXPORT	__attribute__ ((visibility("default")))
+#else
+#define ADK_EXPORT
+#endif
+
+/*
+ * Accessory connection, opaque. The library works on libusb's default
+ * context, so a process drives a single accessory. Functions return 0 or
+ * a negative libusb error code, see adk_strerror(), and never print.
+ */
+typedef struct adk_ctx adk_ctx;
+
+/* adk_init() errors besides the libusb ones */
+#define ADK_ERROR_NO_AOA	-100	/* device does not speak AOA */
+#define ADK_ERROR_NEED_AOA2	-101	/* no application requires AOA 2.0 */
+
+/* Descriptor to poll, events being POLLIN/POLLOUT as in poll() */
+typedef struct {
+	int fd;
+	short events;
+} adk_pollfd;
+
+/*
+ * Completion callback of asynchronous requests, called from the thread
+ * handling events. status is 0 on success or a negative libusb error code,
+ * buf is the buffer given at submission (the report for HID events) and
+ * len the number of bytes actually transferred.
+ */
+typedef void (*adk_callback)(adk_ctx *ctx, int status,
+			     unsigned char *buf, int len, void *user_data);
+
+/*
+ * Setup: adk_new() initializes libusb, adk_set_string() sets the
+ * identification (AOA_STRING_*_ID, NULL not to send it: no manufacturer
+ * nor model to connect without an application, AOA 2.0 only), then
+ * adk_init() opens vid:pid, switches it to accessory mode and opens the
+ * accessory. A device already in accessory mode is used as is.
+ */
+extern ADK_EXPORT adk_ctx *adk_new(int verbose);
+extern ADK_EXPORT int adk_set_string(adk_ctx *ctx, int id,
+				     const char *value);
+extern ADK_EXPORT int adk_init(adk_ctx *ctx, uint16_t vid, uint16_t pid,
+			       int aoa_max_version);
+extern ADK_EXPORT void adk_exit(adk_ctx *ctx);
+extern ADK_EXPORT int adk_claim(adk_ctx *ctx);
+extern ADK_EXPORT const char *adk_strerror(int err);
+
+/* Accessory information, valid once adk_init() succeeded */
+extern ADK_EXPORT uint16_t adk_get_vid(const adk_ctx *ctx);
+extern ADK_EXPORT uint16_t adk_get_pid(const adk_ctx *ctx);
+extern ADK_EXPORT int adk_get_aoa_version(const adk_ctx *ctx);
+extern ADK_EXPORT int adk_get_serial(adk_ctx *ctx, char *buf, int len);
+
+/* Synchronous bulk read, transferred set even on timeout */
+extern ADK_EXPORT int adk_read(adk_ctx *ctx, unsigned char *buf, int len,
+			       int *transferred, unsigned int timeout);
+
+/*
+ * Asynchronous bulk transfers on the accessory interface. The buffer is
+ * used in place and must stay valid until the callback is called.
+ *
+ * Reads on the device side usually only complete on a short packet: a
+ * write whose length may be a multiple of wMaxPacketSize needs
+ * ADK_WRITE_ZLP to be delivered without waiting for more data.
+ */
+#define ADK_WRITE_ZLP		0x01
+
+extern ADK_EXPORT int adk_submit_read(adk_ctx *ctx, unsigned char *buf,
+				      int len, unsigned int timeout,
+				      adk_callback callback, void *user_data);
+extern ADK_EXPORT int adk_submit_write(adk_ctx *ctx, unsigned char *buf,
+				       int len, unsigned int timeout,
+				       unsigned int flags,
+				       adk_callback callback,
+				       void *user_data);
+
+/* Event loop integration, adk_get_pollfds() filling up to max fds */
+extern ADK_EXPORT int adk_handle_events(adk_ctx *ctx, int timeout_ms);
+extern ADK_EXPORT int adk_get_pollfds(adk_ctx *ctx, adk_pollfd *fds,
+				      int max);
+extern ADK_EXPORT int adk_get_next_timeout(adk_ctx *ctx, int *timeout_ms);
+
+/* AOA 2.0 HID devices */
+extern ADK_EXPORT int adk_hid_register(adk_ctx *ctx, uint16_t id,
+				       const unsigned char *descriptor,
+				       int size);
+extern ADK_EXPORT int adk_hid_unregister(adk_ctx *ctx, uint16_t id);
+extern ADK_EXPORT int adk_hid_send(adk_ctx *ctx, uint16_t id,
+				   const unsigned char *report, int len,
+				   unsigned int timeout, adk_callback callback,
+				   void *user_data);
+
+/*
+ * Binary trace of the transfers, recorded per thread, written to path.
+ * Decoded by adk-trace.
+ */
+extern ADK_EXPORT int adk_trace_dump(const char *path);
+
+#endif /* _ADK_H_ */
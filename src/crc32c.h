@@ -0,0 +1,39 @@
+/*
+ * Linux ADK - crc32c.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32C (Castagnoli), as used by iSCSI, ext4 or SCTP. Computed with the
+ * SSE4.2 or ARMv8 CRC instructions when the CPU has them, with a
+ * slicing-by-8 table otherwise.
+ *
+ * crc is the value returned for the previous chunk, 0 to start.
+ */
+extern uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* Name of the implementation in use */
+extern const char *crc32c_impl(void);
+
+#endif /* _CRC32C_H_ */
@@ -24,15 +24,28 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 #include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <libusb.h>
 
 #include "linux-adk.h"
+#include "adk.h"
 #include "hid.h"
+#include "rt.h"
+#include "trace.h"
 
 static void *receive_loop(void *arg)
 {
-	while (!stop_acc) {
+	hid_device *hid = arg;
+	accessory_t *acc = hid->acc;
+
+	rt_configure_thread("hid-events", acc->hid_prio, acc->hid_cpu);
+
+	while (!stop_acc && !hid->stop) {
 		int ret = 0;
 		int i;
 		int nfds = 1;
@@ -46,6 +59,7 @@ static void *receive_loop(void *arg)
 
 		ret = libusb_get_next_timeout(NULL, &tv);
 		if (ret < 0) {
+			trace(TRACE_ERROR, 0, ret, 0, 0);
 			if (ret)
 				printf("USB error : %s\n",
 				       libusb_error_name(ret));
@@ -57,6 +71,7 @@ static void *receive_loop(void *arg)
 								     &zero_tv,
 								     NULL);
 			if (ret) {
+				trace(TRACE_ERROR, 0, ret, 0, 0);
 				if (ret)
 					printf("USB error : %s\n",
 					       libusb_error_name(ret));
@@ -68,7 +83,6 @@ static void *receive_loop(void *arg)
 		FD_ZERO(&rfds);
 		FD_ZERO(&wfds);
 		FD_ZERO(&efds);
-		FD_SET(0, &rfds);
 		poll_list = libusb_get_pollfds(NULL);
 		if (poll_list) {
 			for (i = 0; poll_list[i] != NULL; i++) {
@@ -86,10 +100,17 @@ static void *receive_loop(void *arg)
 		} else
 			break;
 
-		if (tv.tv_sec == 0 && tv.tv_usec == 0)
-			ret = select(nfds, &rfds, &wfds, &efds, NULL);
-		else
-			ret = select(nfds, &rfds, &wfds, &efds, &tv);
+		/* Wake up regularly to notice stop requests */
+		if ((tv.tv_sec == 0 && tv.tv_usec == 0) || tv.tv_sec > 0 ||
+		    tv.tv_usec > 200000) {
+			tv.tv_sec = 0;
+			tv.tv_usec = 200000;
+		}
+		ret = select(nfds, &rfds, &wfds, &efds, &tv);
+		trace(TRACE_WAKEUP, 0, ret, 0, 0);
+		if (ret > 0)
+			__atomic_store_n(&hid->wakeup_ns, time_ns(),
+					 __ATOMIC_RELEASE);
 
 		if (libusb_handle_events_timeout_completed
 		    (NULL, &zero_tv, NULL))
@@ -138,45 +159,87 @@ static int open_device(struct libusb_device_handle **handle,
 	return 0;
 }
 
-static void callback_hid(struct libusb_transfer *transfer)
+static void callback_hid_relayed(adk_ctx * adk, int status,
+				 unsigned char *buf, int len, void *user_data)
 {
-	accessory_t *acc = transfer->user_data;
-	int rc = 0;
+	hid_device *hid = user_data;
 
-	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-		struct libusb_transfer *android_transfer;
-		unsigned char *keybuf;
-		int rc;
+	hid_latency_complete(hid->latency, status);
+}
 
-		android_transfer = libusb_alloc_transfer(0);
-		keybuf = malloc(transfer->actual_length + LIBUSB_CONTROL_SETUP_SIZE);
-		memcpy(keybuf + LIBUSB_CONTROL_SETUP_SIZE, transfer->buffer,
-		       transfer->actual_length);
+/* Reports beyond the tracked ones still hold endpoint 0 until acked */
+static void callback_hid_untracked(adk_ctx * adk, int status,
+				   unsigned char *buf, int len,
+				   void *user_data)
+{
+	hid_device *hid = user_data;
 
-		libusb_fill_control_setup(keybuf,
-					  LIBUSB_ENDPOINT_OUT |
-					  LIBUSB_REQUEST_TYPE_VENDOR,
-					  AOA_SEND_HID_EVENT, 1, 0,
-					  transfer->actual_length);
+	hid_latency_untracked(hid->latency);
+}
 
-		libusb_fill_control_transfer(android_transfer, acc->handle,
-					     keybuf, NULL, NULL, 0);
+/* received is when the report reached the host, sent is now */
+static int relay_hid_report(hid_device * hid, unsigned char *report,
+			    int len, uint64_t received)
+{
+	int rc;
+
+	if (!hid->latency)
+		return adk_hid_send(hid->acc->adk, hid->id, report, len, 0,
+				    NULL, NULL);
+	if (hid_latency_submit(hid->latency, received, time_ns()) < 0)
+		return adk_hid_send(hid->acc->adk, hid->id, report, len, 0,
+				    callback_hid_untracked, hid);
+
+	rc = adk_hid_send(hid->acc->adk, hid->id, report, len, 0,
+			  callback_hid_relayed, hid);
+	if (rc)
+		hid_latency_cancel(hid->latency);
 
-		android_transfer->flags =
-		    LIBUSB_TRANSFER_FREE_BUFFER | LIBUSB_TRANSFER_FREE_TRANSFER;
+	return rc;
+}
 
-		rc = libusb_submit_transfer(android_transfer);
+static void callback_hid(struct libusb_transfer *transfer)
+{
+	hid_device *hid = transfer->user_data;
+	uint64_t now = time_ns();
+	uint64_t received;
+	int rc = 0;
+
+	/*
+	 * The report reached the host when the event thread woke up on the
+	 * completion. Every completion wakes it up, so a wakeup already used
+	 * means another thread handled this one first: no host time known.
+	 */
+	received = __atomic_load_n(&hid->wakeup_ns, __ATOMIC_ACQUIRE);
+	if (!received || (received == hid->received_ns) || (received > now))
+		received = now;
+	hid->received_ns = received;
+
+	trace(TRACE_COMPLETE, transfer->endpoint, transfer->status,
+	      transfer->actual_length, hid->id);
+
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		rc = relay_hid_report(hid, transfer->buffer,
+				      transfer->actual_length, received);
 		if (rc)
-			printf("USB error : %s\n", libusb_error_name(rc));
+			trace(TRACE_ERROR, 0, rc, 0, hid->id);
 
 		rc = libusb_submit_transfer(transfer);
 		if (rc)
-			printf("USB error : %s\n", libusb_error_name(rc));
+			trace(TRACE_ERROR, transfer->endpoint, rc, 0,
+			      hid->id);
+		else
+			trace(TRACE_SUBMIT, transfer->endpoint, 0,
+			      transfer->length, hid->id);
 
 	} else if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
 		rc = libusb_submit_transfer(transfer);
 		if (rc)
-			printf("USB error : %s\n", libusb_error_name(rc));
+			trace(TRACE_ERROR, transfer->endpoint, rc, 0,
+			      hid->id);
+		else
+			trace(TRACE_SUBMIT, transfer->endpoint, 0,
+			      transfer->length, hid->id);
 	}
 }
 
@@ -190,6 +253,7 @@ unsigned char search_hid(hid_device * hid)
 	libusb_device *device;
 
 	hid->handle = NULL;
+	hid->id = HID_PHYSICAL_ID;
 
 	/* List every USB device attached */
 	cnt = libusb_get_device_list(NULL, &list);
@@ -255,7 +319,8 @@ found:
 						       LIBUSB_RECIPIENT_INTERFACE,
 						       LIBUSB_REQUEST_GET_DESCRIPTOR,
 						       LIBUSB_DT_REPORT << 8, 0,
-						       hid->descriptor, 256, 0);
+						       hid->descriptor,
+						       sizeof(hid->descriptor), 0);
 	if (hid->descriptor_size < 0)
 		goto error1;
 
@@ -277,6 +342,9 @@ int register_hid_callback(accessory_t * acc, hid_device * hid)
 	int rc;
 
 	keybuf = malloc(hid->packet_size);
+	hid->acc = acc;
+	hid->wakeup_ns = 0;
+	hid->received_ns = 0;
 
 	hid_transfer = libusb_alloc_transfer(0);
 	if (hid_transfer == NULL) {
@@ -287,7 +355,7 @@ int register_hid_callback(accessory_t * acc, hid_device * hid)
 	libusb_fill_interrupt_transfer(hid_transfer, hid->handle,
 				       hid->endpoint_in,
 				       keybuf, hid->packet_size, callback_hid,
-				       acc, 0);
+				       hid, 0);
 
 	rc = libusb_submit_transfer(hid_transfer);
 	if (rc != 0) {
@@ -304,29 +372,456 @@ int send_hid_descriptor(accessory_t * acc, hid_device * hid)
 {
 	int ret;
 
-	ret = libusb_control_transfer(acc->handle, LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_REGISTER_HID, 1, hid->descriptor_size,
-				      NULL, 0, 0);
+	ret = adk_hid_register(acc->adk, hid->id, hid->descriptor,
+			       hid->descriptor_size);
 	if (ret < 0) {
 		printf("couldn't register HID device on the android device : %s\n",
-		       libusb_error_name(ret));
+		       adk_strerror(ret));
 		libusb_close(hid->handle);
+		hid->handle = NULL;
 		return -1;
 	}
 
-	ret = libusb_control_transfer(acc->handle, LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_SET_HID_REPORT_DESC, 1, 0,
-				      hid->descriptor, hid->descriptor_size, 0);
-	if (ret < 0) {
-		printf("couldn't send HID descriptor to the android device\n");
+	hid->acc = acc;
+	hid->stop = 0;
+	if (pthread_create(&hid->rx_thread, NULL, receive_loop, hid)) {
+		adk_hid_unregister(acc->adk, hid->id);
 		libusb_close(hid->handle);
+		hid->handle = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Largest input report declared by a report descriptor, report ID included */
+static int hid_input_report_size(const unsigned char *desc, int size)
+{
+	uint32_t bits[256] = { 0 };
+	uint32_t stack[4][3];
+	uint32_t report_size = 0, report_count = 0, id = 0;
+	int depth = 0, uses_id = 0, max = 0;
+	int i = 0;
+
+	while (i < size) {
+		unsigned char prefix = desc[i++];
+		int len = ((prefix & 3) == 3) ? 4 : (prefix & 3);
+		uint32_t data = 0;
+		int j;
+
+		/* Long items carry no report layout */
+		if (prefix == 0xfe) {
+			if (i >= size)
+				break;
+			i += 2 + desc[i];
+			continue;
+		}
+		if (i + len > size)
+			break;
+		for (j = 0; j < len; j++)
+			data |= (uint32_t)desc[i + j] << (8 * j);
+		i += len;
+
+		switch (prefix & 0xfc) {
+		case 0x74:	/* Report Size */
+			report_size = data;
+			break;
+		case 0x94:	/* Report Count */
+			report_count = data;
+			break;
+		case 0x84:	/* Report ID */
+			id = data & 0xff;
+			uses_id = 1;
+			break;
+		case 0xa4:	/* Push */
+			if (depth < 4) {
+				stack[depth][0] = report_size;
+				stack[depth][1] = report_count;
+				stack[depth][2] = id;
+			}
+			depth++;
+			break;
+		case 0xb4:	/* Pop */
+			if ((depth > 0) && (--depth < 4)) {
+				report_size = stack[depth][0];
+				report_count = stack[depth][1];
+				id = stack[depth][2];
+			}
+			break;
+		case 0x80:	/* Input */
+			bits[id] += report_size * report_count;
+			break;
+		}
+	}
+
+	for (i = 0; i < 256; i++) {
+		int bytes = (bits[i] + 7) / 8;
+
+		if (bytes && uses_id)
+			bytes++;
+		if (bytes > max)
+			max = bytes;
+	}
+
+	return max;
+}
+
+int load_hid_descriptor(hid_device * hid, const char *path)
+{
+	FILE *f;
+
+	hid->handle = NULL;
+	hid->id = HID_VIRTUAL_ID;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		printf("Unable to open HID descriptor %s\n", path);
+		return -1;
+	}
+
+	hid->descriptor_size = fread(hid->descriptor, 1,
+				     sizeof(hid->descriptor), f);
+	if (!feof(f) || (hid->descriptor_size <= 0)) {
+		printf("Invalid HID descriptor %s\n", path);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	hid->report_size = hid_input_report_size(hid->descriptor,
+						 hid->descriptor_size);
+	if (hid->report_size <= 0) {
+		printf("HID descriptor %s declares no input report\n", path);
+		return -1;
+	}
+
+	printf("=> loaded virtual HID descriptor (%d bytes, reports up to "
+	       "%d bytes)\n", hid->descriptor_size, hid->report_size);
+	return 0;
+}
+
+static void callback_hid_event(adk_ctx * adk, int status,
+			       unsigned char *buf, int len, void *user_data)
+{
+	hid_device *hid = user_data;
+
+	if (status)
+		trace(TRACE_ERROR, 0, status, len, hid->id);
+	if (hid->latency)
+		hid_latency_complete(hid->latency, status);
+
+	pthread_mutex_lock(&hid->lock);
+	hid->inflight--;
+	pthread_cond_signal(&hid->cond);
+	pthread_mutex_unlock(&hid->lock);
+}
+
+/* Wait until at most max transfers are in flight, 0 if stopped meanwhile */
+static int wait_hid_inflight(hid_device * hid, int max)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&hid->lock);
+	while ((hid->inflight > max) && !stop_acc) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&hid->cond, &hid->lock, &ts);
+	}
+	pthread_mutex_unlock(&hid->lock);
+
+	return !stop_acc;
+}
+
+/*
+ * Parses one line of the injection stream:
+ *   <time_us> <byte> <byte> ...
+ * time_us is the offset from the start of the stream at which the report
+ * must be sent, bytes are in hexadecimal. Returns the report length, 0 for
+ * blank/comment lines, -1 on error and -2 for reports longer than max.
+ */
+static int parse_hid_line(char *line, uint64_t * when,
+			  unsigned char *report, int max)
+{
+	char *end;
+	int len = 0;
+
+	while ((*line == ' ') || (*line == '\t'))
+		line++;
+	if ((*line == '\0') || (*line == '#'))
+		return 0;
+
+	*when = strtoull(line, &end, 10);
+	if (end == line)
 		return -1;
+
+	for (line = end; len < max; line = end) {
+		unsigned long byte = strtoul(line, &end, 16);
+
+		if (end == line)
+			break;
+		if (byte > 0xff)
+			return -1;
+		report[len++] = byte;
+	}
+
+	/* Truncating would send the device a different report */
+	if (len == max) {
+		strtoul(line, &end, 16);
+		if (end != line)
+			return -2;
+	}
+
+	return len ? len : -1;
+}
+
+static void wait_until(const struct timespec *start, uint64_t when)
+{
+	struct timespec ts = *start;
+
+	ts.tv_sec += when / 1000000;
+	ts.tv_nsec += (when % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
 	}
 
-	pthread_create(&hid->rx_thread, NULL, receive_loop, NULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	       == EINTR && !stop_acc)
+		;
+}
+
+/* Reads reports from fd and sends them until EOF, returns reports sent */
+static unsigned long inject_stream(hid_device * hid, int fd)
+{
+	unsigned char report[hid->report_size];
+	char buf[4096];
+	size_t fill = 0;
+	unsigned long count = 0;
+	unsigned int lineno = 0;
+	struct timespec start;
+	uint64_t start_ns;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	start_ns = (uint64_t)start.tv_sec * 1000000000ULL + start.tv_nsec;
+
+	while (!stop_acc) {
+		char *line, *nl;
+		ssize_t ret;
+
+		ret = poll(&pfd, 1, 200);
+		if (ret == 0 || (ret < 0 && errno == EINTR))
+			continue;
+		if (ret < 0)
+			break;
+
+		ret = read(fd, buf + fill, sizeof(buf) - fill - 1);
+		if (ret <= 0)
+			break;
+		fill += ret;
+		buf[fill] = '\0';
+
+		for (line = buf; (nl = strchr(line, '\n')) != NULL;
+		     line = nl + 1) {
+			uint64_t when = 0, ref;
+			int len, rc;
+
+			*nl = '\0';
+			lineno++;
+			len = parse_hid_line(line, &when, report,
+					     hid->report_size);
+			if (len == -2)
+				printf("HID input line %u: report longer than "
+				       "%d bytes\n", lineno, hid->report_size);
+			else if (len < 0)
+				printf("HID input line %u: parse error\n",
+				       lineno);
+			if (len <= 0)
+				continue;
+
+			if (!wait_hid_inflight(hid, HID_INJECT_DEPTH - 1))
+				return count;
+			if (when) {
+				wait_until(&start, when);
+				ref = start_ns + when * 1000;
+			} else {
+				ref = time_ns();
+			}
+
+			pthread_mutex_lock(&hid->lock);
+			hid->inflight++;
+			pthread_mutex_unlock(&hid->lock);
+
+			/* In flight reports are bounded well below the slots */
+			if (hid->latency)
+				hid_latency_submit(hid->latency, ref,
+						   time_ns());
+
+			rc = adk_hid_send(hid->acc->adk, hid->id, report, len,
+					  1000, callback_hid_event, hid);
+			if (rc) {
+				trace(TRACE_ERROR, 0, rc, len, hid->id);
+				if (hid->latency)
+					hid_latency_cancel(hid->latency);
+				pthread_mutex_lock(&hid->lock);
+				hid->inflight--;
+				pthread_mutex_unlock(&hid->lock);
+				continue;
+			}
+			count++;
+		}
+
+		/* Keep the incomplete line for the next read */
+		fill -= line - buf;
+		memmove(buf, line, fill);
+		if (fill == sizeof(buf) - 1) {
+			printf("HID input line %u: too long\n", lineno + 1);
+			fill = 0;
+		}
+	}
+
+	return count;
+}
+
+static int listen_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+	    (listen(fd, 1) < 0)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int accept_unix(int listen_fd)
+{
+	struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+
+	while (!stop_acc) {
+		int ret = poll(&pfd, 1, 200);
+
+		if (ret > 0)
+			return accept(listen_fd, NULL, NULL);
+		if (ret < 0 && errno != EINTR)
+			break;
+	}
+
+	return -1;
+}
+
+static void *inject_loop(void *arg)
+{
+	hid_device *hid = arg;
+	int listen_fd = hid->listen_fd;
+	int fd;
+
+	rt_configure_thread("hid-inject", hid->acc->hid_prio,
+			    hid->acc->hid_cpu);
+
+	if (listen_fd >= 0)
+		printf("Waiting for HID reports on %s\n", hid->source + 5);
+
+	while (!stop_acc) {
+		unsigned long count;
+
+		if (listen_fd >= 0)
+			fd = accept_unix(listen_fd);
+		else if (strcmp(hid->source, "-") == 0)
+			fd = STDIN_FILENO;
+		else
+			fd = open(hid->source, O_RDONLY);
+		if (fd < 0) {
+			if (!stop_acc)
+				printf("Unable to open HID input %s\n",
+				       hid->source);
+			break;
+		}
+
+		count = inject_stream(hid, fd);
+		printf("Injected %lu HID reports\n", count);
+
+		if (fd != STDIN_FILENO)
+			close(fd);
+		if (listen_fd < 0)
+			break;
+	}
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(hid->source + 5);
+	}
+
+	/* Let pending events reach the device before removing it */
+	wait_hid_inflight(hid, 0);
+	adk_hid_unregister(hid->acc->adk, hid->id);
+
+	return NULL;
+}
+
+int start_hid_injection(accessory_t * acc, hid_device * hid,
+			const char *source)
+{
+	hid->acc = acc;
+	hid->source = source;
+	hid->inflight = 0;
+	pthread_mutex_init(&hid->lock, NULL);
+	pthread_cond_init(&hid->cond, NULL);
+
+	hid->listen_fd = -1;
+	if (strncmp(source, "unix:", 5) == 0) {
+		hid->listen_fd = listen_unix(source + 5);
+		if (hid->listen_fd < 0) {
+			printf("Unable to listen on %s\n", source + 5);
+			goto error0;
+		}
+	}
+
+	if (send_hid_descriptor(acc, hid) < 0)
+		goto error1;
+
+	if (pthread_create(&hid->tx_thread, NULL, inject_loop, hid)) {
+		printf("Unable to start HID injection\n");
+		goto error2;
+	}
 
 	return 0;
+error2:
+	hid->stop = 1;
+	pthread_join(hid->rx_thread, NULL);
+	adk_hid_unregister(acc->adk, hid->id);
+error1:
+	if (hid->listen_fd >= 0) {
+		close(hid->listen_fd);
+		unlink(source + 5);
+	}
+error0:
+	pthread_mutex_destroy(&hid->lock);
+	pthread_cond_destroy(&hid->cond);
+	return -1;
+}
+
+void stop_hid_injection(hid_device * hid)
+{
+	pthread_join(hid->tx_thread, NULL);
+	pthread_join(hid->rx_thread, NULL);
+	pthread_mutex_destroy(&hid->lock);
+	pthread_cond_destroy(&hid->cond);
 }
 #endif
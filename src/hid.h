@@ -23,19 +23,47 @@
 
 #include <pthread.h>
 
+#include "latency.h"
+
+/* HID IDs used to register devices on the Android side */
+#define HID_PHYSICAL_ID		1
+#define HID_VIRTUAL_ID		2
+
+/* Maximum number of AOA_SEND_HID_EVENT transfers in flight when injecting */
+#define HID_INJECT_DEPTH	32
+
 /* Structures */
 typedef struct {
 	struct libusb_device_handle *handle;
-	unsigned char descriptor[256];
+	unsigned char descriptor[1024];
 	int descriptor_size;
 	int endpoint_in;
 	ssize_t packet_size;
+	uint16_t id;
 	pthread_t rx_thread;
+	int stop;		/* ends rx_thread before stop_acc */
+	accessory_t *acc;
+	hid_latency *latency;	/* NULL unless profiling */
+	/* Physical HID only: last event thread wakeup, and the one used */
+	uint64_t wakeup_ns;
+	uint64_t received_ns;
+	/* Virtual (injected) HID only */
+	int report_size;	/* largest input report */
+	const char *source;
+	int listen_fd;		/* unix:<path> sources */
+	pthread_t tx_thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int inflight;
 } hid_device;
 
 /* Functions */
 extern int send_hid_descriptor(accessory_t *acc, hid_device *hid);
 extern int register_hid_callback(accessory_t* acc, hid_device *hid);
 extern unsigned char search_hid(hid_device *hid);
+extern int load_hid_descriptor(hid_device *hid, const char *path);
+extern int start_hid_injection(accessory_t *acc, hid_device *hid,
+			       const char *source);
+extern void stop_hid_injection(hid_device *hid);
 
 #endif /* _HID_H_ */
@@ -0,0 +1,166 @@
+/*
+ * Linux ADK - histogram.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "histogram.h"
+
+static unsigned int bucket_index(uint64_t value)
+{
+	unsigned int msb;
+
+	if (value < 2 * HISTOGRAM_SUB_COUNT)
+		return value;
+
+	msb = 63 - __builtin_clzll(value);
+	return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT +
+	    ((value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+static uint64_t bucket_value(unsigned int index)
+{
+	unsigned int msb;
+	uint64_t sub;
+
+	if (index < 2 * HISTOGRAM_SUB_COUNT)
+		return index;
+
+	msb = index / HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_BITS - 1;
+	sub = HISTOGRAM_SUB_COUNT + index % HISTOGRAM_SUB_COUNT;
+	return sub << (msb - HISTOGRAM_SUB_BITS);
+}
+
+void histogram_init(histogram_t * h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void histogram_add(histogram_t * h, uint64_t value)
+{
+	h->buckets[bucket_index(value)]++;
+	h->count++;
+	h->sum += value;
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+void histogram_merge(histogram_t * dst, const histogram_t * src)
+{
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const histogram_t * h, double pct)
+{
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (uint64_t)(h->count * pct / 100.0);
+	if (rank >= h->count)
+		return h->max;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			break;
+	}
+
+	/* Clamp the bucket lower bound to the observed range */
+	if (bucket_value(i) < h->min)
+		return h->min;
+	if (bucket_value(i) > h->max)
+		return h->max;
+	return bucket_value(i);
+}
+
+void histogram_print(const histogram_t * h, const char *name)
+{
+	uint64_t peak = 0;
+	int i;
+
+	printf("%s: %llu samples\n", name, (unsigned long long)h->count);
+	if (!h->count)
+		return;
+
+	printf("  min %.1fus avg %.1fus max %.1fus\n", h->min / 1000.0,
+	       (double)h->sum / h->count / 1000.0, h->max / 1000.0);
+	printf("  p50 %.1fus p90 %.1fus p99 %.1fus p99.9 %.1fus "
+	       "p99.99 %.1fus\n",
+	       histogram_percentile(h, 50) / 1000.0,
+	       histogram_percentile(h, 90) / 1000.0,
+	       histogram_percentile(h, 99) / 1000.0,
+	       histogram_percentile(h, 99.9) / 1000.0,
+	       histogram_percentile(h, 99.99) / 1000.0);
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+		if (h->buckets[i] > peak)
+			peak = h->buckets[i];
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		int bar;
+
+		if (!h->buckets[i])
+			continue;
+
+		bar = (h->buckets[i] * 40 + peak - 1) / peak;
+		printf("  >= %10.1fus %10u %.*s\n", bucket_value(i) / 1000.0,
+		       h->buckets[i], bar,
+		       "########################################");
+	}
+}
+
+/* One line summary, for reports showing several histograms */
+void histogram_print_line(const histogram_t * h, const char *name)
+{
+	if (!h->count) {
+		printf("  %-8s no samples\n", name);
+		return;
+	}
+
+	printf("  %-8s avg %9.1fus p50 %9.1fus p99 %9.1fus max %9.1fus\n",
+	       name, (double)h->sum / h->count / 1000.0,
+	       histogram_percentile(h, 50) / 1000.0,
+	       histogram_percentile(h, 99) / 1000.0, h->max / 1000.0);
+}
+
+uint64_t time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
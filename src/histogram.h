@@ -0,0 +1,54 @@
+/*
+ * Linux ADK - histogram.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+/*
+ * Log-linear histogram: every power of two is split in 8 sub-buckets,
+ * which keeps the relative error under 12.5% for any value.
+ */
+#define HISTOGRAM_SUB_BITS	3
+#define HISTOGRAM_SUB_COUNT	(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS	((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/* Structures */
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+/* Functions */
+extern void histogram_init(histogram_t *h);
+extern void histogram_add(histogram_t *h, uint64_t value);
+extern void histogram_merge(histogram_t *dst, const histogram_t *src);
+extern uint64_t histogram_percentile(const histogram_t *h, double pct);
+extern void histogram_print(const histogram_t *h, const char *name);
+extern void histogram_print_line(const histogram_t *h, const char *name);
+
+/* Monotonic time in nanoseconds, the unit of every histogram */
+extern uint64_t time_ns(void);
+
+#endif /* _HISTOGRAM_H_ */
@@ -0,0 +1,162 @@
+/*
+ * Linux ADK - integrity.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+
+#include "crc32c.h"
+#include "integrity.h"
+
+enum {
+	INTEGRITY_STATE_HEADER,
+	INTEGRITY_STATE_PAYLOAD,
+	INTEGRITY_STATE_TRAILER,
+};
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void integrity_init(integrity_t *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->state = INTEGRITY_STATE_HEADER;
+}
+
+/*
+ * Frames the len bytes of payload found at frame + INTEGRITY_HEADER, the
+ * buffer having room for INTEGRITY_OVERHEAD more bytes. Returns the size
+ * of the frame to send.
+ */
+size_t integrity_seal(void *frame, size_t len)
+{
+	uint8_t *p = frame;
+
+	put_le32(p, INTEGRITY_MAGIC);
+	put_le32(p + 4, len);
+	put_le32(p + 8, crc32c(0, p, 8));
+	put_le32(p + INTEGRITY_HEADER + len,
+		 crc32c(0, p, INTEGRITY_HEADER + len));
+
+	return len + INTEGRITY_OVERHEAD;
+}
+
+static int header_valid(const uint8_t *p)
+{
+	return (get_le32(p) == INTEGRITY_MAGIC) &&
+	    (get_le32(p + 4) <= INTEGRITY_MAX_BLOCK) &&
+	    (get_le32(p + 8) == crc32c(0, p, 8));
+}
+
+/*
+ * Verifies the len received bytes of buf, and moves the payload they
+ * carry to the start of buf. Returns the number of payload bytes.
+ * Payload is handed over before its CRC arrives: a mismatch is counted
+ * and reported, not prevented. Bytes skipped while looking for the next
+ * valid header are dropped.
+ */
+size_t integrity_check(integrity_t *ctx, uint8_t *buf, size_t len)
+{
+	uint8_t *in = buf, *end = buf + len, *out = buf;
+	unsigned int need;
+	size_t n;
+
+	while (in < end) {
+		if (ctx->state == INTEGRITY_STATE_PAYLOAD) {
+			n = ctx->len - ctx->done;
+			if (n > (size_t)(end - in))
+				n = end - in;
+			ctx->crc = crc32c(ctx->crc, in, n);
+			if (out != in)
+				memmove(out, in, n);
+			out += n;
+			in += n;
+			ctx->done += n;
+			if (ctx->done == ctx->len)
+				ctx->state = INTEGRITY_STATE_TRAILER;
+			continue;
+		}
+
+		/* Header or CRC, possibly split across transfers */
+		need = (ctx->state == INTEGRITY_STATE_TRAILER) ?
+		    INTEGRITY_TRAILER : INTEGRITY_HEADER;
+		n = need - ctx->field_len;
+		if (n > (size_t)(end - in))
+			n = end - in;
+		memcpy(ctx->field + ctx->field_len, in, n);
+		ctx->field_len += n;
+		in += n;
+		if (ctx->field_len < need)
+			continue;
+
+		if (ctx->state == INTEGRITY_STATE_TRAILER) {
+			uint32_t value = get_le32(ctx->field);
+
+			ctx->blocks++;
+			ctx->bytes += ctx->len;
+			/* Counted only, reported by integrity_report() */
+			if (value != ctx->crc)
+				ctx->mismatches++;
+			ctx->field_len = 0;
+			ctx->state = INTEGRITY_STATE_HEADER;
+			continue;
+		}
+
+		if (!header_valid(ctx->field)) {
+			/* Out of step: slide by one byte until a valid header */
+			if (!ctx->lost)
+				ctx->framing_errors++;
+			ctx->lost = 1;
+			memmove(ctx->field, ctx->field + 1, INTEGRITY_HEADER - 1);
+			ctx->field_len = INTEGRITY_HEADER - 1;
+			continue;
+		}
+
+		ctx->lost = 0;
+		ctx->field_len = 0;
+		ctx->len = get_le32(ctx->field + 4);
+		ctx->done = 0;
+		ctx->crc = crc32c(0, ctx->field, INTEGRITY_HEADER);
+		ctx->state = ctx->len ? INTEGRITY_STATE_PAYLOAD :
+		    INTEGRITY_STATE_TRAILER;
+	}
+
+	return out - buf;
+}
+
+void integrity_report(const integrity_t *ctx, const char *name)
+{
+	printf("%s integrity (crc32c %s): %llu blocks, %llu bytes, "
+	       "%llu CRC mismatches, %llu framing errors\n", name,
+	       crc32c_impl(), (unsigned long long)ctx->blocks,
+	       (unsigned long long)ctx->bytes,
+	       (unsigned long long)ctx->mismatches,
+	       (unsigned long long)ctx->framing_errors);
+}
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Linux ADK - integrity.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _INTEGRITY_H_
+#define _INTEGRITY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Integrity framing of a bulk stream: every block is sent as
+ *   [magic u32 LE][length u32 LE][header CRC-32C u32 LE][payload]
+ *   [CRC-32C u32 LE]
+ * the header CRC covering magic and length, the last one the header and
+ * payload. Blocks may be split or merged arbitrarily by the USB transfers,
+ * the checker is a byte stream state machine which, once out of step,
+ * scans byte by byte for the next valid header.
+ */
+#define INTEGRITY_MAGIC		0x494b4441	/* "ADKI" */
+#define INTEGRITY_HEADER	12
+#define INTEGRITY_TRAILER	4
+#define INTEGRITY_OVERHEAD	(INTEGRITY_HEADER + INTEGRITY_TRAILER)
+#define INTEGRITY_MAX_BLOCK	(1024 * 1024)
+
+/* Structures */
+typedef struct {
+	int state;
+	uint32_t len;
+	uint32_t done;
+	uint32_t crc;
+	uint8_t field[INTEGRITY_HEADER];
+	unsigned int field_len;
+	int lost;
+	uint64_t blocks;
+	uint64_t bytes;
+	uint64_t mismatches;
+	uint64_t framing_errors;
+} integrity_t;
+
+/* Functions */
+extern void integrity_init(integrity_t *ctx);
+extern size_t integrity_seal(void *frame, size_t len);
+extern size_t integrity_check(integrity_t *ctx, uint8_t *buf, size_t len);
+extern void integrity_report(const integrity_t *ctx, const char *name);
+
+#endif /* _INTEGRITY_H_ */
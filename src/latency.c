@@ -0,0 +1,146 @@
+/*
+ * Linux ADK - latency.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+
+/*
+ * HID latency profiling. Each report goes through three stages:
+ *  - host: from the completion of the interrupt transfer that delivered
+ *    the physical report (or the due time of an injected one) to the
+ *    AOA_SEND_HID_EVENT submission, i.e. processing on the host;
+ *  - queue: control transfers are serialized on the device endpoint 0, so
+ *    a report waits in libusb/the kernel for the previous ones to be acked;
+ *  - device: from the end of the previous transfer (or the submission) to
+ *    the completion, i.e. the time taken by the device to ack it.
+ * Control transfers complete in order, so samples are kept in a FIFO and
+ * no per-report allocation is needed.
+ */
+
+/* Endpoint 0 is shared by every HID device of the accessory */
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t ep0_last_complete;
+
+void hid_latency_init(hid_latency * lat, uint16_t id)
+{
+	memset(lat, 0, sizeof(*lat));
+	lat->id = id;
+	histogram_init(&lat->host);
+	histogram_init(&lat->queue);
+	histogram_init(&lat->device);
+	histogram_init(&lat->total);
+	histogram_init(&lat->depth);
+}
+
+/* Called before submitting, as completion may happen before it returns */
+int hid_latency_submit(hid_latency * lat, uint64_t ref, uint64_t submit)
+{
+	hid_latency_sample *sample;
+	int depth;
+
+	pthread_mutex_lock(&latency_lock);
+	depth = lat->head - lat->tail;
+	if (depth >= HID_LATENCY_SLOTS) {
+		lat->overflows++;
+		pthread_mutex_unlock(&latency_lock);
+		return -1;
+	}
+
+	sample = &lat->samples[lat->head++ & (HID_LATENCY_SLOTS - 1)];
+	sample->ref = ref;
+	sample->submit = submit;
+
+	histogram_add(&lat->depth, depth + 1);
+	if (depth + 1 > lat->max_depth)
+		lat->max_depth = depth + 1;
+	pthread_mutex_unlock(&latency_lock);
+
+	return 0;
+}
+
+/* Drops the last sample when its submission failed */
+void hid_latency_cancel(hid_latency * lat)
+{
+	pthread_mutex_lock(&latency_lock);
+	lat->head--;
+	pthread_mutex_unlock(&latency_lock);
+}
+
+void hid_latency_complete(hid_latency * lat, int status)
+{
+	hid_latency_sample *sample;
+	uint64_t now = time_ns();
+	uint64_t start;
+
+	pthread_mutex_lock(&latency_lock);
+	if (lat->head == lat->tail) {
+		pthread_mutex_unlock(&latency_lock);
+		return;
+	}
+
+	sample = &lat->samples[lat->tail++ & (HID_LATENCY_SLOTS - 1)];
+	start = sample->submit > ep0_last_complete ?
+	    sample->submit : ep0_last_complete;
+	ep0_last_complete = now;
+
+	if (status) {
+		lat->errors++;
+	} else {
+		histogram_add(&lat->host, sample->submit - sample->ref);
+		histogram_add(&lat->queue, start - sample->submit);
+		histogram_add(&lat->device, now - start);
+		histogram_add(&lat->total, now - sample->ref);
+	}
+	pthread_mutex_unlock(&latency_lock);
+}
+
+/*
+ * Completion of a report sent without a sample (all slots busy): it is not
+ * measured, but the next report waited for it on endpoint 0.
+ */
+void hid_latency_untracked(hid_latency * lat)
+{
+	pthread_mutex_lock(&latency_lock);
+	ep0_last_complete = time_ns();
+	pthread_mutex_unlock(&latency_lock);
+}
+
+void hid_latency_report(hid_latency * lat)
+{
+	printf("HID %u latency: %llu reports, %llu errors, "
+	       "%llu untracked\n", lat->id,
+	       (unsigned long long)lat->total.count,
+	       (unsigned long long)lat->errors,
+	       (unsigned long long)lat->overflows);
+	if (!lat->total.count)
+		return;
+
+	histogram_print_line(&lat->host, "host");
+	histogram_print_line(&lat->queue, "queue");
+	histogram_print_line(&lat->device, "device");
+	histogram_print_line(&lat->total, "total");
+	printf("  %-8s avg %.2f p99 %llu max %d in flight\n", "depth",
+	       (double)lat->depth.sum / lat->depth.count,
+	       (unsigned long long)histogram_percentile(&lat->depth, 99),
+	       lat->max_depth);
+}
+#endif
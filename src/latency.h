@@ -0,0 +1,62 @@
+/*
+ * Linux ADK - latency.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "histogram.h"
+
+/* Reports tracked between submission and completion, power of 2 */
+#define HID_LATENCY_SLOTS	256
+
+/* Structures */
+typedef struct {
+	uint64_t ref;		/* report ready: event thread wakeup/due time */
+	uint64_t submit;	/* AOA_SEND_HID_EVENT submitted */
+} hid_latency_sample;
+
+typedef struct {
+	uint16_t id;
+	uint32_t head;
+	uint32_t tail;
+	uint64_t errors;
+	uint64_t overflows;
+	int max_depth;
+	hid_latency_sample samples[HID_LATENCY_SLOTS];
+	histogram_t host;
+	histogram_t queue;
+	histogram_t device;
+	histogram_t total;
+	histogram_t depth;
+} hid_latency;
+
+/* Functions */
+extern void hid_latency_init(hid_latency *lat, uint16_t id);
+extern int hid_latency_submit(hid_latency *lat, uint64_t ref,
+			      uint64_t submit);
+extern void hid_latency_cancel(hid_latency *lat);
+extern void hid_latency_complete(hid_latency *lat, int status);
+extern void hid_latency_untracked(hid_latency *lat);
+extern void hid_latency_report(hid_latency *lat);
+
+#endif /* _LATENCY_H_ */
@@ -26,11 +26,17 @@
 #include <libusb.h>
 
 #include "linux-adk.h"
+#include "adk.h"
+#include "trace.h"
+#ifndef WIN32
+#include "rt.h"
+#endif
 
 extern void accessory_main(accessory_t * acc);
 
-volatile int stop_acc = 0;
 int verbose = 0;
+volatile int stop_acc = 0;
+static const char *trace_file = TRACE_DEFAULT_FILE;
 
 static const accessory_t acc_default = {
 	.device = "18d1:4e42",
@@ -40,22 +46,49 @@ static const accessory_t acc_default = {
 	.version = "1.0",
 	.url = "https://github.com/gibsson",
 	.serial = "0000000012345678",
+	.hid_input = "-",
+	.tune_cache = "/var/tmp/linux-adk.tune",
+	.ping_count = 1000,
 };
 
-static int is_accessory_present(accessory_t * acc);
-static int init_accessory(accessory_t * acc, int aoa_max_version);
-static void fini_accessory(accessory_t * acc);
-
 static void show_help(char *name)
 {
 	printf
 	    ("Linux Accessory Development Kit\n\nusage: %s [OPTIONS]\nOPTIONS:\n"
 	     "\t-a, --aoa-max-version\n\t\tAOA maximum version to be used. "
 	     "Default is no maximum version.\n"
+	     "\t-A, --autotune\n\t\tadapt the bulk transfers size and "
+	     "queue depth at runtime: \"throughput\" to maximize the "
+	     "throughput, or a 99th percentile latency target in us.\n"
+	     "\t-c, --cpu\n\t\tCPU(s) to pin the bulk[,HID] USB threads to. "
+	     "Default is no affinity.\n"
+	     "\t-C, --integrity\n\t\tverify the CRC-32C framing of the "
+	     "received data and report mismatches.\n"
 	     "\t-d, --device\n\t\tUSB device product and vendor IDs. "
 	     "Default is \"%s\".\n"
 	     "\t-D, --description\n\t\taccessory description. "
 	     "Default is \"%s\".\n"
+	     "\t-E, --stages\n\t\tscheduling of the pipeline stages "
+	     "(integrity, output) as comma separated "
+	     "name[:priority[:cpu]], implies --pipeline. Default is the "
+	     "bulk thread priority and no affinity.\n"
+	     "\t-g, --ping\n\t\tmeasure round-trip times with probes of "
+	     "the given comma separated sizes, echoed by the application, "
+	     "instead of receiving data.\n"
+	     "\t-G, --ping-count\n\t\tnumber of probes per size. "
+	     "Default is %d.\n"
+	     "\t-H, --hid-inject\n\t\tregister a virtual HID device using "
+	     "the given report descriptor file (AOA v2.0 only).\n"
+	     "\t-I, --hid-input\n\t\tsource of the virtual HID reports: "
+	     "\"-\" for stdin, a file/FIFO path or unix:<path> for a local "
+	     "socket. Default is \"%s\".\n"
+	     "\t-j, --jitter\n\t\tmeasure the wakeup latency distribution "
+	     "for the given number of seconds with the bulk thread settings "
+	     "and exit.\n"
+	     "\t-K, --tune-cache\n\t\tfile caching the tuned parameters "
+	     "of every device. Default is \"%s\".\n"
+	     "\t-L, --mlock\n\t\tlock and prefault all memory to avoid "
+	     "page faults in the USB paths.\n"
 	     "\t-m, --manufacturer\n\t\tmanufacturer's name. "
 	     "Default is \"%s\".\n"
 	     "\t-M, --model\n\t\tmodel's name. "
@@ -64,16 +97,45 @@ static void show_help(char *name)
 	     "Default is \"%s\".\n"
 	     "\t-N, --no_app\n\t\toption that allows to connect without an "
 	     "Android App (AOA v2.0 only, for Audio and HID).\n"
+	     "\t-o, --output\n\t\tcapture received data to the given file "
+	     "instead of displaying it.\n"
+	     "\t-O, --output-direct\n\t\tuse O_DIRECT for the capture "
+	     "file.\n"
+	     "\t-p, --pipeline\n\t\tprocess the received data on worker "
+	     "threads, the USB thread only queueing buffers.\n"
+	     "\t-P, --hid-latency\n\t\tprofile the HID reports latency and "
+	     "print where the time goes on exit.\n"
+	     "\t-r, --rt-prio\n\t\tSCHED_FIFO priority(ies) of the "
+	     "bulk[,HID] USB threads. Default is the normal scheduler.\n"
+	     "\t-R, --shm-ring\n\t\tpublish the received data to the given "
+	     "shared memory ring (e.g. /linux-adk) for local readers such "
+	     "as adk-shm, instead of displaying it.\n"
 	     "\t-s, --serial\n\t\tserial numder. "
 	     "Default is \"%s\".\n"
+	     "\t-S, --rotate-size\n\t\tstart a new capture file every given "
+	     "number of MiB.\n"
+	     "\t-t, --trace\n\t\tfile the binary trace is dumped to on exit, "
+	     "to be decoded with adk-trace. Default is \"%s\".\n"
+	     "\t-T, --rotate-time\n\t\tstart a new capture file every given "
+	     "number of seconds.\n"
 	     "\t-u, --url\n\t\taccessory url. "
 	     "Default is \"%s\".\n"
 	     "\t-v, --version\n\t\tShow program version and exit.\n"
 	     "\t-V, --verbose\n\t\tSets libusb verbose mode.\n"
+	     "\t-w, --sweep\n\t\tchart the echo throughput against the "
+	     "probe size.\n"
+	     "\t-x, --mux\n\t\tmultiplex channels over the accessory "
+	     "interface, each served on a local socket in the given "
+	     "directory, instead of receiving data.\n"
+	     "\t-X, --mux-channels\n\t\tcomma separated channels as "
+	     "id[:priority[:weight]]. Default is channels 0 to 3, all "
+	     "priority 0 and weight 1.\n"
 	     "\t-h, --help\n\t\tShow this help and exit.\n", name,
 	     acc_default.device, acc_default.description,
-	     acc_default.manufacturer, acc_default.model, acc_default.version,
-	     acc_default.serial, acc_default.url);
+	     acc_default.ping_count, acc_default.hid_input, acc_default.tune_cache,
+	     acc_default.manufacturer,
+	     acc_default.model, acc_default.version, acc_default.serial,
+	     TRACE_DEFAULT_FILE, acc_default.url);
 	return;
 }
 
@@ -84,23 +146,53 @@ static void show_version(char *name)
 	return;
 }
 
+/* Parses "a[,b]", b defaulting to a */
+static void parse_pair(const char *arg, int *a, int *b)
+{
+	char *end;
+
+	*a = strtol(arg, &end, 10);
+	*b = (*end == ',') ? strtol(end + 1, NULL, 10) : *a;
+}
+
 static void signal_handler(int signo)
 {
 	printf("SIGINT: Closing accessory\n");
 	stop_acc = 1;
 }
 
+#ifndef WIN32
+/* Keep the trace of what led to a crash */
+static void fatal_handler(int signo)
+{
+	adk_trace_dump(trace_file);
+	signal(signo, SIG_DFL);
+	raise(signo);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 	int arg_count = 1;
 	int no_app = 0;
 	int aoa_max_version = -1;
-	accessory_t acc = { NULL, NULL, 0, 0, 0, NULL, NULL, NULL, NULL, NULL,
-		NULL, NULL
+	uint16_t vid, pid;
+	char *tmp;
+	int ret;
+	int lock_memory = 0;
+	int jitter = 0;
+	accessory_t acc = {
+		.bulk_cpu = -1,
+		.hid_cpu = -1,
 	};
 
 	if (signal(SIGINT, signal_handler) == SIG_ERR)
 		printf("Cannot setup a signal handler...\n");
+#ifndef WIN32
+	signal(SIGSEGV, fatal_handler);
+	signal(SIGBUS, fatal_handler);
+	signal(SIGABRT, fatal_handler);
+#endif
 
 	/* Disable buffering on stdout */
 	setbuf(stdout, NULL);
@@ -110,6 +202,16 @@ int main(int argc, char *argv[])
 		if ((strcmp(argv[arg_count], "-a") == 0)
 		    || (strcmp(argv[arg_count], "--aoa-max-version") == 0)) {
 			aoa_max_version= atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-A") == 0)
+			   || (strcmp(argv[arg_count], "--autotune") == 0)) {
+			acc.autotune = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-c") == 0)
+			   || (strcmp(argv[arg_count], "--cpu") == 0)) {
+			parse_pair(argv[++arg_count], &acc.bulk_cpu,
+				   &acc.hid_cpu);
+		} else if ((strcmp(argv[arg_count], "-C") == 0)
+			   || (strcmp(argv[arg_count], "--integrity") == 0)) {
+			acc.integrity = 1;
 		} else if ((strcmp(argv[arg_count], "-d") == 0)
 			   || (strcmp(argv[arg_count], "--device") == 0)) {
 			acc.device = argv[++arg_count];
@@ -117,6 +219,31 @@ int main(int argc, char *argv[])
 			   || (strcmp(argv[arg_count], "--description")
 			       == 0)) {
 			acc.description = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-E") == 0)
+			   || (strcmp(argv[arg_count], "--stages") == 0)) {
+			acc.stages = argv[++arg_count];
+			acc.pipeline = 1;
+		} else if ((strcmp(argv[arg_count], "-g") == 0)
+			   || (strcmp(argv[arg_count], "--ping") == 0)) {
+			acc.ping = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-G") == 0)
+			   || (strcmp(argv[arg_count], "--ping-count") == 0)) {
+			acc.ping_count = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-H") == 0)
+			   || (strcmp(argv[arg_count], "--hid-inject") == 0)) {
+			acc.hid_inject = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-I") == 0)
+			   || (strcmp(argv[arg_count], "--hid-input") == 0)) {
+			acc.hid_input = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-j") == 0)
+			   || (strcmp(argv[arg_count], "--jitter") == 0)) {
+			jitter = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-K") == 0)
+			   || (strcmp(argv[arg_count], "--tune-cache") == 0)) {
+			acc.tune_cache = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-L") == 0)
+			   || (strcmp(argv[arg_count], "--mlock") == 0)) {
+			lock_memory = 1;
 		} else if ((strcmp(argv[arg_count], "-m") == 0)
 			   || (strcmp(argv[arg_count], "--manufacturer")
 			       == 0)) {
@@ -131,9 +258,41 @@ int main(int argc, char *argv[])
 		} else if ((strcmp(argv[arg_count], "-N") == 0)
 			   || (strcmp(argv[arg_count], "--no_app") == 0)) {
 			no_app = 1;
+		} else if ((strcmp(argv[arg_count], "-o") == 0)
+			   || (strcmp(argv[arg_count], "--output") == 0)) {
+			acc.output = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-O") == 0)
+			   || (strcmp(argv[arg_count], "--output-direct")
+			       == 0)) {
+			acc.output_direct = 1;
+		} else if ((strcmp(argv[arg_count], "-p") == 0)
+			   || (strcmp(argv[arg_count], "--pipeline") == 0)) {
+			acc.pipeline = 1;
+		} else if ((strcmp(argv[arg_count], "-P") == 0)
+			   || (strcmp(argv[arg_count], "--hid-latency")
+			       == 0)) {
+			acc.hid_latency = 1;
+		} else if ((strcmp(argv[arg_count], "-r") == 0)
+			   || (strcmp(argv[arg_count], "--rt-prio") == 0)) {
+			parse_pair(argv[++arg_count], &acc.bulk_prio,
+				   &acc.hid_prio);
+		} else if ((strcmp(argv[arg_count], "-R") == 0)
+			   || (strcmp(argv[arg_count], "--shm-ring") == 0)) {
+			acc.shm_ring = argv[++arg_count];
 		} else if ((strcmp(argv[arg_count], "-s") == 0)
 			   || (strcmp(argv[arg_count], "--serial") == 0)) {
 			acc.serial = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-t") == 0)
+			   || (strcmp(argv[arg_count], "--trace") == 0)) {
+			trace_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-S") == 0)
+			   || (strcmp(argv[arg_count], "--rotate-size")
+			       == 0)) {
+			acc.rotate_size = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-T") == 0)
+			   || (strcmp(argv[arg_count], "--rotate-time")
+			       == 0)) {
+			acc.rotate_time = atoi(argv[++arg_count]);
 		} else if ((strcmp(argv[arg_count], "-u") == 0)
 			   || (strcmp(argv[arg_count], "--url") == 0)) {
 			acc.url = argv[++arg_count];
@@ -144,6 +303,16 @@ int main(int argc, char *argv[])
 		} else if ((strcmp(argv[arg_count], "-V") == 0)
 			   || (strcmp(argv[arg_count], "--verbose") == 0)) {
 			verbose = 1;
+		} else if ((strcmp(argv[arg_count], "-w") == 0)
+			   || (strcmp(argv[arg_count], "--sweep") == 0)) {
+			acc.ping_sweep = 1;
+		} else if ((strcmp(argv[arg_count], "-x") == 0)
+			   || (strcmp(argv[arg_count], "--mux") == 0)) {
+			acc.mux = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-X") == 0)
+			   || (strcmp(argv[arg_count], "--mux-channels")
+			       == 0)) {
+			acc.mux_channels = argv[++arg_count];
 		} else {
 			show_help(argv[0]);
 			exit(1);
@@ -166,243 +335,73 @@ int main(int argc, char *argv[])
 		acc.serial = acc_default.serial;
 	if (!acc.url)
 		acc.url = acc_default.url;
+	if (!acc.hid_input)
+		acc.hid_input = acc_default.hid_input;
+	if (!acc.tune_cache)
+		acc.tune_cache = acc_default.tune_cache;
+	if (acc.ping_count <= 0)
+		acc.ping_count = acc_default.ping_count;
+
+	/* Only the received data is framed, which ping and mux replace */
+	if (acc.integrity && (acc.ping || acc.ping_sweep || acc.mux)) {
+		printf("--integrity cannot be used with --ping, --sweep "
+		       "nor --mux\n");
+		exit(1);
+	}
 #ifdef WIN32
 	/* AOA 2.0 not supported on Windows (pthread/hid/audio deps) */
 	aoa_max_version = 1;
-#endif
-	if (init_accessory(&acc, aoa_max_version) != 0)
-		goto end;
-
-	accessory_main(&acc);
+#else
+	if (lock_memory)
+		rt_lock_memory();
 
-end:
-	fini_accessory(&acc);
-	return 0;
-}
-
-static int init_accessory(accessory_t * acc, int aoa_max_version)
-{
-	int ret;
-	uint16_t pid, vid;
-	char *tmp;
-	uint8_t buffer[2];
-	int tries = 10;
-
-	/* Initializing libusb */
-	ret = libusb_init(NULL);
-	if (ret != 0) {
-		printf("libusb init failed: %d\n", ret);
-		return ret;
+	if (jitter > 0) {
+		rt_measure_jitter(acc.bulk_prio, acc.bulk_cpu, jitter);
+		return 0;
+	}
+#endif
+	acc.adk = adk_new(verbose);
+	if (acc.adk == NULL) {
+		printf("libusb init failed\n");
+		return 1;
 	}
-	if (verbose)
-		libusb_set_option(NULL, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
 
-	/* Check if device is not already in accessory mode */
-	if (is_accessory_present(acc))
-		return 0;
+	adk_set_string(acc.adk, AOA_STRING_MAN_ID, acc.manufacturer);
+	adk_set_string(acc.adk, AOA_STRING_MOD_ID, acc.model);
+	adk_set_string(acc.adk, AOA_STRING_DSC_ID, acc.description);
+	adk_set_string(acc.adk, AOA_STRING_VER_ID, acc.version);
+	adk_set_string(acc.adk, AOA_STRING_URL_ID, acc.url);
+	adk_set_string(acc.adk, AOA_STRING_SER_ID, acc.serial);
 
 	/* Getting product and vendor IDs */
-	vid = (uint16_t) strtol(acc->device, &tmp, 16);
+	vid = (uint16_t) strtol(acc.device, &tmp, 16);
 	pid = (uint16_t) strtol(tmp + 1, &tmp, 16);
 	printf("Looking for device %4.4x:%4.4x\n", vid, pid);
 
-	/* Trying to open it */
-	acc->handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (acc->handle == NULL) {
-		printf("Unable to open device...\n");
-		return -1;
-	}
-
-	/* Now asking if device supports Android Open Accessory protocol */
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_IN |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_GET_PROTOCOL, 0, 0, buffer,
-				      sizeof(buffer), 0);
-	if (ret < 0) {
-		printf("Error getting protocol...\n");
-		return ret;
-	} else {
-		acc->aoa_version = ((buffer[1] << 8) | buffer[0]);
-		printf("Device supports AOA %d.0!\n", acc->aoa_version);
-	}
-	if ((aoa_max_version > 0) && ((int)acc->aoa_version > aoa_max_version)) {
-		acc->aoa_version = aoa_max_version;
-		printf("Limiting AOA to version %d.0!\n", acc->aoa_version);
-	}
-
-	/* Some Android devices require a waiting period between transfer calls */
-	usleep(10000);
-
-	/* In case of a no_app accessory, the version must be >= 2 */
-	if ((acc->aoa_version < 2) && !acc->manufacturer) {
+	ret = adk_init(acc.adk, vid, pid, aoa_max_version);
+	if (ret == ADK_ERROR_NEED_AOA2) {
 		printf("Connecting without an Android App only for AOA 2.0\n");
-		return -1;
-	}
-
-	printf("Sending identification to the device\n");
-
-	if (acc->manufacturer) {
-		printf(" sending manufacturer: %s\n", acc->manufacturer);
-		ret = libusb_control_transfer(acc->handle,
-					      LIBUSB_ENDPOINT_OUT
-					      | LIBUSB_REQUEST_TYPE_VENDOR,
-					      AOA_SEND_IDENT, 0,
-					      AOA_STRING_MAN_ID,
-					      (uint8_t *) acc->manufacturer,
-					      strlen(acc->manufacturer) + 1, 0);
-		if (ret < 0)
-			goto error;
-	}
-
-	if (acc->model) {
-		printf(" sending model: %s\n", acc->model);
-		ret = libusb_control_transfer(acc->handle,
-					      LIBUSB_ENDPOINT_OUT
-					      | LIBUSB_REQUEST_TYPE_VENDOR,
-					      AOA_SEND_IDENT, 0,
-					      AOA_STRING_MOD_ID,
-					      (uint8_t *) acc->model,
-					      strlen(acc->model) + 1, 0);
-		if (ret < 0)
-			goto error;
-	}
-
-	printf(" sending description: %s\n", acc->description);
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_SEND_IDENT, 0, AOA_STRING_DSC_ID,
-				      (uint8_t *) acc->description,
-				      strlen(acc->description) + 1, 0);
-	if (ret < 0)
-		goto error;
-
-	printf(" sending version: %s\n", acc->version);
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_SEND_IDENT, 0, AOA_STRING_VER_ID,
-				      (uint8_t *) acc->version,
-				      strlen(acc->version) + 1, 0);
-	if (ret < 0)
-		goto error;
-
-	printf(" sending url: %s\n", acc->url);
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_SEND_IDENT, 0, AOA_STRING_URL_ID,
-				      (uint8_t *) acc->url,
-				      strlen(acc->url) + 1, 0);
-	if (ret < 0)
-		goto error;
-
-	printf(" sending serial number: %s\n", acc->serial);
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_SEND_IDENT, 0, AOA_STRING_SER_ID,
-				      (uint8_t *) acc->serial,
-				      strlen(acc->serial) + 1, 0);
-	if (ret < 0)
-		goto error;
-
-	if (acc->aoa_version >= 2) {
-		printf(" asking for audio support\n");
-		ret = libusb_control_transfer(acc->handle,
-					      LIBUSB_ENDPOINT_OUT
-					      | LIBUSB_REQUEST_TYPE_VENDOR,
-					      AOA_AUDIO_SUPPORT, 1, 0, 0, 0, 0);
-		if (ret < 0)
-			goto error;
-	}
-
-	printf("Turning the device in Accessory mode\n");
-	ret = libusb_control_transfer(acc->handle,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_VENDOR,
-				      AOA_START_ACCESSORY, 0, 0, NULL, 0, 0);
-	if (ret < 0)
-		goto error;
-
-	/* Let some time for the new enumeration to happen */
-	usleep(10000);
-
-	/* Connect to the Accessory */
-	while (tries--) {
-		if (is_accessory_present(acc))
-			break;
-		else if (!tries)
-			goto error;
-		else
-			sleep(1);
+		goto end;
+	} else if (ret == ADK_ERROR_NO_AOA) {
+		printf("Device does not support AOA\n");
+		goto end;
+	} else if (ret != 0) {
+		printf("Accessory init failed: %s\n", adk_strerror(ret));
+		goto end;
 	}
 
-	return 0;
+	if (adk_get_aoa_version(acc.adk))
+		printf("Using AOA %d.0\n", adk_get_aoa_version(acc.adk));
+	printf("Found accessory %4.4x:%4.4x\n", adk_get_vid(acc.adk),
+	       adk_get_pid(acc.adk));
 
-error:
-	printf("Accessory init failed: %d\n", ret);
-	return -1;
-}
-
-static int is_accessory_present(accessory_t * acc)
-{
-	struct libusb_device_handle *handle;
-	uint16_t vid = AOA_ACCESSORY_VID;
-	uint16_t pid = 0;
-
-	/* Trying to open all the AOA IDs possible */
-	pid = AOA_ACCESSORY_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
-
-	pid = AOA_ACCESSORY_ADB_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
-
-	pid = AOA_AUDIO_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
-
-	pid = AOA_AUDIO_ADB_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
-
-	pid = AOA_ACCESSORY_AUDIO_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
-
-	pid = AOA_ACCESSORY_AUDIO_ADB_PID;
-	handle = libusb_open_device_with_vid_pid(NULL, vid, pid);
-	if (handle != NULL)
-		goto claim;
+	accessory_main(&acc);
 
+end:
+	adk_exit(acc.adk);
+#ifndef WIN32
+	if (adk_trace_dump(trace_file) == 0)
+		printf("Trace dumped to %s\n", trace_file);
+#endif
 	return 0;
-
-claim:
-	printf("Found accessory %4.4x:%4.4x\n", vid, pid);
-	acc->handle = handle;
-	acc->vid = vid;
-	acc->pid = pid;
-	return 1;
-}
-
-static void fini_accessory(accessory_t * acc)
-{
-	printf("Closing USB device\n");
-
-	if (acc->handle != NULL) {
-		libusb_release_interface(acc->handle, 0);
-		libusb_close(acc->handle);
-	}
-
-	libusb_exit(NULL);
-
-	return;
 }
@@ -0,0 +1,704 @@
+/*
+ * Linux ADK - mux.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <endian.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <libusb.h>
+
+#include "linux-adk.h"
+#include "adk.h"
+#include "histogram.h"
+#include "mux.h"
+#include "trace.h"
+
+/*
+ * Every channel is a SOCK_SEQPACKET socket named ch<N> in the mux
+ * directory, accepting one client at a time: each message the client
+ * sends is queued for the device, each message received from the device
+ * is sent to the client.
+ *
+ * To the device, fragments are picked by strict priority, then by deficit
+ * round robin between channels of the same priority: every round a
+ * channel may send weight * MUX_QUANTUM bytes. Fragments are gathered in
+ * batches of up to MUX_BATCH bytes with at most MUX_WRITES batches in
+ * flight, which bounds how long a control message waits behind bulk
+ * traffic. A channel whose queue is full stops being read, so a fast
+ * client only ever blocks itself.
+ *
+ * From the device, there is no flow control: a message its client does
+ * not accept right away is dropped and accounted for.
+ */
+#define MUX_QUANTUM		(MUX_HEADER_SIZE + MUX_FRAGMENT)
+#define MUX_QUEUE_BYTES		(256 * 1024)
+#define MUX_BATCH		(16 * 1024)
+#define MUX_WRITES		2
+#define MUX_READS		4
+#define MUX_READ_SIZE		(16 * 1024)
+#define MUX_USB_FDS		16
+#define MUX_DEFAULT_CHANNELS	4
+
+typedef struct mux_msg {
+	struct mux_msg *next;
+	uint64_t queued_ns;
+	int len;
+	int sent;
+	unsigned char data[];
+} mux_msg;
+
+typedef struct {
+	int configured;
+	int prio;
+	int weight;
+	int listen_fd;
+	int client_fd;
+	int hangup;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	/* To the device */
+	mux_msg *head;
+	mux_msg *tail;
+	int queued;		/* bytes of memory held by the queue */
+	int deficit;
+	int visited;
+	uint64_t tx_msgs;
+	uint64_t tx_bytes;
+	histogram_t tx_delay;
+	/* From the device */
+	unsigned char *rasm;
+	int rasm_len;
+	int oversized;
+	uint64_t rx_msgs;
+	uint64_t rx_bytes;
+	uint64_t rx_drops;
+} mux_channel;
+
+typedef struct mux_ctx mux_ctx;
+
+typedef struct {
+	mux_ctx *ctx;
+	int busy;
+	unsigned char *buf;
+} mux_tx;
+
+struct mux_ctx {
+	accessory_t *acc;
+	pthread_mutex_t lock;
+	int stopping;
+	mux_channel ch[MUX_MAX_CHANNELS];
+	int cursor;
+	/* Transfers */
+	int writes;
+	int reads;
+	mux_tx tx[MUX_WRITES];
+	unsigned char *rx[MUX_READS];
+	/* Frame being received */
+	mux_header hdr;
+	int hdr_len;
+	int payload_left;
+	uint64_t bad_frames;
+	uint64_t errors;
+	/* Message being read from a client */
+	unsigned char *msg;
+};
+
+/* Parses "ch[:prio[:weight]],...", all channels left unconfigured first */
+static int mux_parse_channels(mux_ctx * ctx, const char *spec)
+{
+	char *copy, *tok, *save;
+	int ret = 0;
+
+	if (spec == NULL) {
+		int i;
+
+		for (i = 0; i < MUX_DEFAULT_CHANNELS; i++) {
+			ctx->ch[i].configured = 1;
+			ctx->ch[i].weight = 1;
+		}
+		return 0;
+	}
+
+	copy = strdup(spec);
+	if (copy == NULL)
+		return -1;
+
+	for (tok = strtok_r(copy, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		int id, prio = 0, weight = 1;
+
+		if ((sscanf(tok, "%d:%d:%d", &id, &prio, &weight) < 1) ||
+		    (id < 0) || (id >= MUX_MAX_CHANNELS) || (weight < 1)) {
+			printf("Invalid mux channel \"%s\"\n", tok);
+			ret = -1;
+			break;
+		}
+		ctx->ch[id].configured = 1;
+		ctx->ch[id].prio = prio;
+		ctx->ch[id].weight = weight;
+	}
+
+	free(copy);
+	return ret;
+}
+
+static int mux_listen(mux_channel * ch, const char *dir, int id)
+{
+	struct sockaddr_un addr;
+	int ret;
+
+	ret = snprintf(ch->path, sizeof(ch->path), "%s/ch%d", dir, id);
+	if ((ret < 0) || (ret >= (int)sizeof(ch->path))) {
+		printf("Mux directory path too long\n");
+		ch->path[0] = '\0';
+		return -1;
+	}
+
+	ch->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (ch->listen_fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, ch->path, sizeof(addr.sun_path) - 1);
+	unlink(ch->path);
+
+	if ((bind(ch->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	    || (listen(ch->listen_fd, 1) < 0)) {
+		printf("Unable to listen on %s: %s\n", ch->path,
+		       strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Size of the next frame of a channel, with ctx->lock held */
+static int mux_frame_size(const mux_channel * ch)
+{
+	int left = ch->head->len - ch->head->sent;
+
+	return MUX_HEADER_SIZE + (left > MUX_FRAGMENT ? MUX_FRAGMENT : left);
+}
+
+/*
+ * Channel the next frame comes from, with ctx->lock held. The quantum
+ * being at least a full frame, a round never ends without a pick.
+ */
+static mux_channel *mux_pick(mux_ctx * ctx)
+{
+	mux_channel *ch;
+	int prio = INT_MIN;
+	int i, active = 0;
+
+	for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+		if (ctx->ch[i].head && (ctx->ch[i].prio >= prio)) {
+			prio = ctx->ch[i].prio;
+			active = 1;
+		}
+	}
+	if (!active)
+		return NULL;
+
+	for (;;) {
+		ch = &ctx->ch[ctx->cursor];
+		if (ch->head && (ch->prio == prio)) {
+			if (!ch->visited) {
+				ch->deficit += ch->weight * MUX_QUANTUM;
+				ch->visited = 1;
+			}
+			if (mux_frame_size(ch) <= ch->deficit)
+				return ch;
+		}
+		ch->visited = 0;
+		if (!ch->head)
+			ch->deficit = 0;
+		ctx->cursor = (ctx->cursor + 1) % MUX_MAX_CHANNELS;
+	}
+}
+
+/* Gathers frames into buf, with ctx->lock held; returns its length */
+static int mux_batch(mux_ctx * ctx, unsigned char *buf)
+{
+	uint64_t now = time_ns();
+	mux_channel *ch;
+	int len = 0;
+
+	while ((ch = mux_pick(ctx)) != NULL) {
+		mux_msg *msg = ch->head;
+		mux_header *hdr = (mux_header *) (buf + len);
+		int size = mux_frame_size(ch);
+
+		if (len + size > MUX_BATCH)
+			break;
+
+		ch->deficit -= size;
+		size -= MUX_HEADER_SIZE;
+		hdr->channel = ch - ctx->ch;
+		hdr->flags = 0;
+		hdr->len = htole16(size);
+		memcpy(buf + len + MUX_HEADER_SIZE, msg->data + msg->sent, size);
+		len += MUX_HEADER_SIZE + size;
+
+		msg->sent += size;
+		ch->tx_bytes += size;
+		if (msg->sent == msg->len) {
+			hdr->flags = MUX_FLAG_END;
+			histogram_add(&ch->tx_delay, now - msg->queued_ns);
+			ch->tx_msgs++;
+			ch->head = msg->next;
+			if (ch->head == NULL)
+				ch->tail = NULL;
+			ch->queued -= sizeof(*msg) + msg->len;
+			free(msg);
+		}
+	}
+
+	return len;
+}
+
+static void callback_write(adk_ctx * adk, int status, unsigned char *buf,
+			   int len, void *user_data);
+
+/* Submits batches while writes are free, with ctx->lock held */
+static void mux_fill(mux_ctx * ctx)
+{
+	int i, len;
+
+	for (i = 0; (i < MUX_WRITES) && !ctx->stopping; i++) {
+		mux_tx *tx = &ctx->tx[i];
+
+		if (tx->busy)
+			continue;
+
+		len = mux_batch(ctx, tx->buf);
+		if (!len)
+			return;
+
+		/*
+		 * A partial write would desynchronize the device side. A
+		 * batch of whole packets needs a zero length packet, or it
+		 * waits on the device for the next one.
+		 */
+		if (adk_submit_write(ctx->acc->adk, tx->buf, len, 1000,
+				     ADK_WRITE_ZLP, callback_write, tx) != 0) {
+			ctx->errors++;
+			ctx->stopping = 1;
+			return;
+		}
+		tx->busy = 1;
+		ctx->writes++;
+	}
+}
+
+static void callback_write(adk_ctx * adk, int status, unsigned char *buf,
+			   int len, void *user_data)
+{
+	mux_tx *tx = user_data;
+	mux_ctx *ctx = tx->ctx;
+
+	pthread_mutex_lock(&ctx->lock);
+	tx->busy = 0;
+	ctx->writes--;
+	if (status) {
+		ctx->errors++;
+		trace(TRACE_ERROR, AOA_ACCESSORY_EP_OUT, status, len,
+		      ctx->errors);
+		ctx->stopping = 1;
+	}
+	mux_fill(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Hands a complete message to the client, with ctx->lock held */
+static void mux_deliver(mux_channel * ch)
+{
+	if (ch->oversized || (ch->client_fd < 0) ||
+	    (send(ch->client_fd, ch->rasm, ch->rasm_len,
+		  MSG_DONTWAIT | MSG_NOSIGNAL) < 0)) {
+		ch->rx_drops++;
+	} else {
+		ch->rx_msgs++;
+		ch->rx_bytes += ch->rasm_len;
+	}
+
+	ch->rasm_len = 0;
+	ch->oversized = 0;
+}
+
+/* Splits the stream from the device into frames, with ctx->lock held */
+static void mux_parse(mux_ctx * ctx, const unsigned char *buf, int len)
+{
+	while (len > 0) {
+		mux_channel *ch = NULL;
+		int n;
+
+		if (ctx->hdr_len < MUX_HEADER_SIZE) {
+			n = MUX_HEADER_SIZE - ctx->hdr_len;
+			if (n > len)
+				n = len;
+			memcpy((unsigned char *)&ctx->hdr + ctx->hdr_len, buf,
+			       n);
+			ctx->hdr_len += n;
+			buf += n;
+			len -= n;
+			if (ctx->hdr_len < MUX_HEADER_SIZE)
+				break;
+
+			ctx->payload_left = le16toh(ctx->hdr.len);
+			if ((ctx->hdr.channel >= MUX_MAX_CHANNELS) ||
+			    !ctx->ch[ctx->hdr.channel].configured)
+				ctx->bad_frames++;
+		}
+
+		if ((ctx->hdr.channel < MUX_MAX_CHANNELS) &&
+		    ctx->ch[ctx->hdr.channel].configured)
+			ch = &ctx->ch[ctx->hdr.channel];
+
+		n = ctx->payload_left < len ? ctx->payload_left : len;
+		if (ch && n) {
+			if (ch->rasm_len + n > MUX_MAX_MESSAGE) {
+				ch->oversized = 1;
+			} else if (!ch->oversized) {
+				memcpy(ch->rasm + ch->rasm_len, buf, n);
+				ch->rasm_len += n;
+			}
+		}
+		buf += n;
+		len -= n;
+		ctx->payload_left -= n;
+		if (ctx->payload_left)
+			break;
+
+		if (ch && (ctx->hdr.flags & MUX_FLAG_END))
+			mux_deliver(ch);
+		ctx->hdr_len = 0;
+	}
+}
+
+static void callback_read(adk_ctx * adk, int status, unsigned char *buf,
+			  int len, void *user_data)
+{
+	mux_ctx *ctx = user_data;
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->reads--;
+
+	if (len > 0)
+		mux_parse(ctx, buf, len);
+	if (status && (status != LIBUSB_ERROR_TIMEOUT)) {
+		ctx->errors++;
+		trace(TRACE_ERROR, AOA_ACCESSORY_EP_IN, status, len,
+		      ctx->errors);
+		ctx->stopping = 1;
+	}
+
+	if (!ctx->stopping &&
+	    (adk_submit_read(adk, buf, MUX_READ_SIZE, 200, callback_read,
+			     ctx) == 0))
+		ctx->reads++;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void mux_accept(mux_ctx * ctx, mux_channel * ch)
+{
+	int fd;
+
+	fd = accept(ch->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	pthread_mutex_lock(&ctx->lock);
+	if (ch->client_fd >= 0) {
+		/* One client per channel, first come first served */
+		pthread_mutex_unlock(&ctx->lock);
+		printf("%s already in use\n", ch->path);
+		close(fd);
+		return;
+	}
+	ch->client_fd = fd;
+	ch->hangup = 0;
+	pthread_mutex_unlock(&ctx->lock);
+	printf("Client attached to %s\n", ch->path);
+}
+
+static void mux_disconnect(mux_ctx * ctx, mux_channel * ch)
+{
+	pthread_mutex_lock(&ctx->lock);
+	close(ch->client_fd);
+	ch->client_fd = -1;
+	pthread_mutex_unlock(&ctx->lock);
+	printf("Client detached from %s\n", ch->path);
+}
+
+/*
+ * Queues one message of the client, already sent ones being kept. Empty
+ * messages are valid: once the client hung up, they can't be told from
+ * the end of the stream, which is what they are taken for.
+ */
+static void mux_receive(mux_ctx * ctx, mux_channel * ch)
+{
+	mux_msg *msg;
+	ssize_t len;
+
+	len = recv(ch->client_fd, ctx->msg, MUX_MAX_MESSAGE,
+		   MSG_DONTWAIT | MSG_TRUNC);
+	if ((len < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+		return;
+	if ((len < 0) || ((len == 0) && ch->hangup)) {
+		mux_disconnect(ctx, ch);
+		return;
+	}
+	if (len > MUX_MAX_MESSAGE) {
+		printf("%s: message of %zd bytes dropped, maximum is %d\n",
+		       ch->path, len, MUX_MAX_MESSAGE);
+		return;
+	}
+
+	msg = malloc(sizeof(*msg) + len);
+	if (msg == NULL)
+		return;
+	msg->next = NULL;
+	msg->queued_ns = time_ns();
+	msg->len = len;
+	msg->sent = 0;
+	memcpy(msg->data, ctx->msg, len);
+
+	pthread_mutex_lock(&ctx->lock);
+	if (ch->tail)
+		ch->tail->next = msg;
+	else
+		ch->head = msg;
+	ch->tail = msg;
+	ch->queued += sizeof(*msg) + len;
+	mux_fill(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void mux_run(mux_ctx * ctx)
+{
+	adk_pollfd usb_fds[MUX_USB_FDS];
+	struct pollfd fds[2 * MUX_MAX_CHANNELS + MUX_USB_FDS];
+	mux_channel *owner[2 * MUX_MAX_CHANNELS];
+	int i, nfds, nsock, nusb, timeout, ret, full;
+
+	nusb = adk_get_pollfds(ctx->acc->adk, usb_fds, MUX_USB_FDS);
+
+	while (!stop_acc) {
+		int usb_ready = 0;
+
+		nfds = 0;
+		pthread_mutex_lock(&ctx->lock);
+		if (ctx->stopping) {
+			pthread_mutex_unlock(&ctx->lock);
+			break;
+		}
+		for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+			mux_channel *ch = &ctx->ch[i];
+
+			if (!ch->configured)
+				continue;
+			owner[nfds] = ch;
+			fds[nfds].fd = ch->listen_fd;
+			fds[nfds++].events = POLLIN;
+			if (ch->client_fd < 0)
+				continue;
+			/*
+			 * A full queue leaves the client blocked on send(),
+			 * or its last messages in the socket once it hung up.
+			 */
+			if (ch->queued >= MUX_QUEUE_BYTES) {
+				if (ch->hangup)
+					continue;
+				owner[nfds] = ch;
+				fds[nfds].fd = ch->client_fd;
+				fds[nfds++].events = 0;
+				continue;
+			}
+			owner[nfds] = ch;
+			fds[nfds].fd = ch->client_fd;
+			fds[nfds++].events = POLLIN | POLLRDHUP;
+		}
+		pthread_mutex_unlock(&ctx->lock);
+
+		nsock = nfds;
+		for (i = 0; i < nusb; i++) {
+			fds[nfds].fd = usb_fds[i].fd;
+			fds[nfds++].events = usb_fds[i].events;
+		}
+
+		adk_get_next_timeout(ctx->acc->adk, &timeout);
+		if ((timeout < 0) || (timeout > 100))
+			timeout = 100;
+
+		ret = poll(fds, nfds, timeout);
+		if ((ret < 0) && (errno != EINTR))
+			break;
+
+		for (i = nsock; i < nfds; i++)
+			if ((ret > 0) && fds[i].revents)
+				usb_ready = 1;
+		if (usb_ready || !ret || (nusb <= 0))
+			adk_handle_events(ctx->acc->adk, 0);
+
+		for (i = 0; (ret > 0) && (i < nsock); i++) {
+			if (!fds[i].revents)
+				continue;
+			if (fds[i].fd == owner[i]->listen_fd) {
+				mux_accept(ctx, owner[i]);
+				continue;
+			}
+			if (fds[i].revents & (POLLHUP | POLLRDHUP | POLLERR))
+				owner[i]->hangup = 1;
+			pthread_mutex_lock(&ctx->lock);
+			full = owner[i]->queued >= MUX_QUEUE_BYTES;
+			pthread_mutex_unlock(&ctx->lock);
+			if (!full)
+				mux_receive(ctx, owner[i]);
+		}
+	}
+}
+
+static void mux_report(mux_ctx * ctx)
+{
+	int i;
+
+	printf("Mux channels:\n");
+	for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+		mux_channel *ch = &ctx->ch[i];
+
+		if (!ch->configured)
+			continue;
+		printf("  ch%-2d prio %d weight %d: sent %llu msgs (%llu "
+		       "bytes), received %llu msgs (%llu bytes), %llu "
+		       "dropped\n", i, ch->prio, ch->weight,
+		       (unsigned long long)ch->tx_msgs,
+		       (unsigned long long)ch->tx_bytes,
+		       (unsigned long long)ch->rx_msgs,
+		       (unsigned long long)ch->rx_bytes,
+		       (unsigned long long)ch->rx_drops);
+		histogram_print_line(&ch->tx_delay, "queued");
+	}
+	if (ctx->bad_frames || ctx->errors)
+		printf("  %llu frames for unknown channels, %llu transfer "
+		       "errors\n", (unsigned long long)ctx->bad_frames,
+		       (unsigned long long)ctx->errors);
+}
+
+void mux_main(accessory_t * acc)
+{
+	static mux_ctx ctx;
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.acc = acc;
+	pthread_mutex_init(&ctx.lock, NULL);
+	for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+		ctx.ch[i].listen_fd = ctx.ch[i].client_fd = -1;
+		histogram_init(&ctx.ch[i].tx_delay);
+	}
+
+	if (mux_parse_channels(&ctx, acc->mux_channels) != 0)
+		goto end;
+	if ((mkdir(acc->mux, 0755) < 0) && (errno != EEXIST)) {
+		printf("Unable to create %s: %s\n", acc->mux, strerror(errno));
+		goto end;
+	}
+
+	ctx.msg = malloc(MUX_MAX_MESSAGE);
+	if (ctx.msg == NULL)
+		goto end;
+	for (i = 0; i < MUX_WRITES; i++) {
+		ctx.tx[i].ctx = &ctx;
+		ctx.tx[i].buf = malloc(MUX_BATCH);
+		if (ctx.tx[i].buf == NULL)
+			goto end;
+	}
+	for (i = 0; i < MUX_READS; i++) {
+		ctx.rx[i] = malloc(MUX_READ_SIZE);
+		if (ctx.rx[i] == NULL)
+			goto end;
+	}
+	for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+		if (!ctx.ch[i].configured)
+			continue;
+		ctx.ch[i].rasm = malloc(MUX_MAX_MESSAGE);
+		if ((ctx.ch[i].rasm == NULL) ||
+		    (mux_listen(&ctx.ch[i], acc->mux, i) != 0))
+			goto end;
+		printf("Channel %d (priority %d, weight %d) on %s\n", i,
+		       ctx.ch[i].prio, ctx.ch[i].weight, ctx.ch[i].path);
+	}
+
+	pthread_mutex_lock(&ctx.lock);
+	for (i = 0; i < MUX_READS; i++)
+		if (adk_submit_read(acc->adk, ctx.rx[i], MUX_READ_SIZE, 200,
+				    callback_read, &ctx) == 0)
+			ctx.reads++;
+	pthread_mutex_unlock(&ctx.lock);
+
+	mux_run(&ctx);
+
+	/* Reads time out regularly, so everything drains once stopping */
+	pthread_mutex_lock(&ctx.lock);
+	ctx.stopping = 1;
+	while (ctx.reads || ctx.writes) {
+		pthread_mutex_unlock(&ctx.lock);
+		adk_handle_events(acc->adk, 100);
+		pthread_mutex_lock(&ctx.lock);
+	}
+	pthread_mutex_unlock(&ctx.lock);
+
+	mux_report(&ctx);
+end:
+	for (i = 0; i < MUX_MAX_CHANNELS; i++) {
+		mux_channel *ch = &ctx.ch[i];
+
+		while (ch->head) {
+			mux_msg *msg = ch->head;
+
+			ch->head = msg->next;
+			free(msg);
+		}
+		if (ch->client_fd >= 0)
+			close(ch->client_fd);
+		if (ch->listen_fd >= 0) {
+			close(ch->listen_fd);
+			unlink(ch->path);
+		}
+		free(ch->rasm);
+	}
+	for (i = 0; i < MUX_READS; i++)
+		free(ctx.rx[i]);
+	for (i = 0; i < MUX_WRITES; i++)
+		free(ctx.tx[i].buf);
+	free(ctx.msg);
+	pthread_mutex_destroy(&ctx.lock);
+}
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Linux ADK - mux.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _MUX_H_
+#define _MUX_H_
+
+#include <stdint.h>
+
+#include "linux-adk.h"
+
+/*
+ * Channel multiplexing: both bulk endpoints carry a stream of frames made
+ * of this header (little-endian) followed by len bytes of payload.
+ * Messages longer than MUX_FRAGMENT are split in several frames, the last
+ * one flagged MUX_FLAG_END, so a large message never holds the link for
+ * more than one fragment. Frames of different channels interleave freely.
+ */
+#define MUX_MAX_CHANNELS	16
+#define MUX_HEADER_SIZE		4
+#define MUX_FRAGMENT		4096
+#define MUX_MAX_MESSAGE		(256 * 1024)
+#define MUX_FLAG_END		0x01
+
+typedef struct {
+	uint8_t channel;
+	uint8_t flags;
+	uint16_t len;		/* payload bytes following the header */
+} __attribute__ ((packed)) mux_header;
+
+/* Functions */
+extern void mux_main(accessory_t *acc);
+
+#endif /* _MUX_H_ */
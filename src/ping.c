@@ -0,0 +1,447 @@
+/*
+ * Linux ADK - ping.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <endian.h>
+#include <pthread.h>
+
+#include <libusb.h>
+
+#include "linux-adk.h"
+#include "adk.h"
+#include "histogram.h"
+#include "ping.h"
+
+/*
+ * Probes are sent asynchronously, at most window of them waiting for
+ * their echo: 1 to measure round-trip times, more to measure throughput.
+ * Reads are always pending on EP_IN and the echoed stream is reassembled
+ * into probes, matched by run and sequence number.
+ */
+#define PING_WINDOW		8
+#define PING_SLOTS		64	/* sequence numbers tracked, power of 2 */
+#define PING_READS		4
+#define PING_READ_SIZE		(64 * 1024)
+#define PING_TIMEOUT_NS		1000000000ULL
+#define PING_SWEEP_NS		2000000000ULL
+#define PING_SWEEP_MIN		64
+
+typedef struct ping_ctx ping_ctx;
+
+typedef struct {
+	ping_ctx *ctx;
+	int busy;
+	unsigned char *buf;
+} ping_tx;
+
+struct ping_ctx {
+	accessory_t *acc;
+	pthread_mutex_t lock;
+	uint16_t run;
+	int size;
+	int window;
+	uint32_t count;		/* probes to send, 0 for a timed run */
+	uint64_t deadline;
+	int stopping;
+	int done;
+	/* Sending */
+	uint32_t next_seq;
+	int outstanding;
+	int writes;
+	ping_tx tx[PING_WINDOW];
+	uint64_t sent_ns[PING_SLOTS];
+	int pending[PING_SLOTS];
+	/* Receiving */
+	int reads;
+	unsigned char *rx[PING_READS];
+	unsigned char *rasm;
+	size_t rasm_len;
+	/* Results */
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t echoed;
+	uint64_t echoed_bytes;
+	uint64_t lost;
+	uint64_t late;
+	uint64_t corrupted;
+	uint64_t errors;
+	uint64_t prev_rtt;
+	uint64_t jitter_sum;
+	histogram_t rtt;
+};
+
+static void callback_write(adk_ctx * adk, int status, unsigned char *buf,
+			   int len, void *user_data);
+static void callback_read(adk_ctx * adk, int status, unsigned char *buf,
+			  int len, void *user_data);
+
+/* Sends probes until the window is full, with ctx->lock held */
+static void ping_fill(ping_ctx * ctx)
+{
+	uint64_t now = time_ns();
+	int i;
+
+	while (!ctx->stopping && (ctx->outstanding < ctx->window) &&
+	       (!ctx->count || (ctx->next_seq < ctx->count)) &&
+	       (!ctx->deadline || (now < ctx->deadline))) {
+		ping_header *hdr;
+		uint32_t slot;
+
+		for (i = 0; i < PING_WINDOW; i++)
+			if (!ctx->tx[i].busy)
+				break;
+		if (i == PING_WINDOW)
+			return;
+
+		slot = ctx->next_seq & (PING_SLOTS - 1);
+		hdr = (ping_header *) ctx->tx[i].buf;
+		hdr->magic = htole32(PING_MAGIC);
+		hdr->run = htole16(ctx->run);
+		hdr->flags = 0;
+		hdr->seq = htole32(ctx->next_seq);
+		hdr->size = htole32(ctx->size);
+		now = time_ns();
+		hdr->timestamp = htole64(now);
+
+		/* Probes of 512 * k bytes must not wait for the next one */
+		if (adk_submit_write(ctx->acc->adk, ctx->tx[i].buf, ctx->size,
+				     1000, ADK_WRITE_ZLP, callback_write,
+				     &ctx->tx[i]) != 0) {
+			ctx->errors++;
+			ctx->stopping = 1;
+			return;
+		}
+		ctx->tx[i].busy = 1;
+		ctx->writes++;
+		ctx->sent_ns[slot] = now;
+		ctx->pending[slot] = 1;
+		ctx->outstanding++;
+		ctx->next_seq++;
+	}
+}
+
+/* Gives up on probes not echoed in time, with ctx->lock held */
+static void ping_expire(ping_ctx * ctx)
+{
+	uint64_t now = time_ns();
+	uint32_t slot;
+
+	for (slot = 0; slot < PING_SLOTS; slot++) {
+		if (ctx->pending[slot] &&
+		    (now - ctx->sent_ns[slot] > PING_TIMEOUT_NS)) {
+			ctx->pending[slot] = 0;
+			ctx->outstanding--;
+			ctx->lost++;
+		}
+	}
+}
+
+static void ping_echo(ping_ctx * ctx, const ping_header * hdr, uint64_t now)
+{
+	uint32_t seq = le32toh(hdr->seq);
+	uint32_t slot = seq & (PING_SLOTS - 1);
+	uint64_t rtt;
+
+	if ((le16toh(hdr->run) != ctx->run) || (seq >= ctx->next_seq) ||
+	    (ctx->next_seq - seq > PING_SLOTS) || !ctx->pending[slot]) {
+		ctx->late++;
+		return;
+	}
+
+	ctx->pending[slot] = 0;
+	ctx->outstanding--;
+	ctx->echoed++;
+	ctx->echoed_bytes += ctx->size;
+	ctx->end_ns = now;
+
+	rtt = now - le64toh(hdr->timestamp);
+	histogram_add(&ctx->rtt, rtt);
+	/* Jitter as the mean deviation between consecutive round trips */
+	if (ctx->echoed > 1)
+		ctx->jitter_sum += rtt > ctx->prev_rtt ?
+		    rtt - ctx->prev_rtt : ctx->prev_rtt - rtt;
+	ctx->prev_rtt = rtt;
+}
+
+/* Splits the echoed stream into probes */
+static void ping_parse(ping_ctx * ctx, uint64_t now)
+{
+	size_t off = 0;
+
+	while (ctx->rasm_len - off >= PING_HEADER_SIZE) {
+		const ping_header *hdr =
+		    (const ping_header *)(ctx->rasm + off);
+		uint32_t size = le32toh(hdr->size);
+
+		if ((le32toh(hdr->magic) != PING_MAGIC) ||
+		    (size < PING_HEADER_SIZE) || (size > PING_MAX_SIZE)) {
+			/* Lost sync, look for the next header */
+			ctx->corrupted++;
+			off++;
+			continue;
+		}
+		if (ctx->rasm_len - off < size)
+			break;
+
+		ping_echo(ctx, hdr, now);
+		off += size;
+	}
+
+	memmove(ctx->rasm, ctx->rasm + off, ctx->rasm_len - off);
+	ctx->rasm_len -= off;
+}
+
+static void ping_check_done(ping_ctx * ctx)
+{
+	uint64_t now = time_ns();
+
+	if (!ctx->stopping &&
+	    ((stop_acc) || (ctx->count && (ctx->next_seq >= ctx->count) &&
+			    !ctx->outstanding) ||
+	     (ctx->deadline && (now >= ctx->deadline))))
+		ctx->stopping = 1;
+
+	if (ctx->stopping && !ctx->reads && !ctx->writes)
+		ctx->done = 1;
+}
+
+static void callback_write(adk_ctx * adk, int status, unsigned char *buf,
+			   int len, void *user_data)
+{
+	ping_tx *tx = user_data;
+	ping_ctx *ctx = tx->ctx;
+
+	pthread_mutex_lock(&ctx->lock);
+	tx->busy = 0;
+	ctx->writes--;
+	/* A probe not sent in time is accounted as lost when it expires */
+	if (status && (status != LIBUSB_ERROR_TIMEOUT)) {
+		ctx->errors++;
+		ctx->stopping = 1;
+	}
+
+	ping_fill(ctx);
+	ping_check_done(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void callback_read(adk_ctx * adk, int status, unsigned char *buf,
+			  int len, void *user_data)
+{
+	ping_ctx *ctx = user_data;
+	uint64_t now = time_ns();
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->reads--;
+
+	if ((len > 0) && (ctx->rasm_len + len <= 2 * PING_MAX_SIZE)) {
+		memcpy(ctx->rasm + ctx->rasm_len, buf, len);
+		ctx->rasm_len += len;
+		ping_parse(ctx, now);
+	} else if (len > 0) {
+		/* Garbage that never parses, start over */
+		ctx->corrupted++;
+		ctx->rasm_len = 0;
+	}
+	if (status && (status != LIBUSB_ERROR_TIMEOUT)) {
+		ctx->errors++;
+		ctx->stopping = 1;
+	}
+
+	ping_expire(ctx);
+	ping_check_done(ctx);
+	ping_fill(ctx);
+
+	if (!ctx->stopping) {
+		if (adk_submit_read(adk, buf, PING_READ_SIZE, 200,
+				    callback_read, ctx) == 0)
+			ctx->reads++;
+	}
+	ping_check_done(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+}
+static int ping_done(ping_ctx * ctx)
+{
+	int done;
+
+	pthread_mutex_lock(&ctx->lock);
+	done = ctx->done;
+	pthread_mutex_unlock(&ctx->lock);
+
+	return done;
+}
+
+/* One measurement: count probes, or as many as possible until duration */
+static void ping_run(ping_ctx * ctx, int size, int window, uint32_t count,
+		     uint64_t duration)
+{
+	int i;
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->run++;
+	ctx->size = size;
+	ctx->window = window;
+	ctx->count = count;
+	ctx->stopping = ctx->done = 0;
+	ctx->next_seq = 0;
+	ctx->outstanding = 0;
+	ctx->rasm_len = 0;
+	memset(ctx->pending, 0, sizeof(ctx->pending));
+	ctx->echoed = ctx->echoed_bytes = 0;
+	ctx->lost = ctx->late = ctx->corrupted = ctx->errors = 0;
+	ctx->prev_rtt = ctx->jitter_sum = 0;
+	histogram_init(&ctx->rtt);
+
+	ctx->start_ns = ctx->end_ns = time_ns();
+	ctx->deadline = duration ? ctx->start_ns + duration : 0;
+	for (i = 0; i < PING_READS; i++)
+		if (adk_submit_read(ctx->acc->adk, ctx->rx[i], PING_READ_SIZE,
+				    200, callback_read, ctx) == 0)
+			ctx->reads++;
+	ping_fill(ctx);
+	ping_check_done(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+
+	/* Reads time out regularly, so everything drains once stopping */
+	while (!ping_done(ctx))
+		adk_handle_events(ctx->acc->adk, 100);
+}
+
+static void ping_print_header(void)
+{
+	printf("%8s %8s %6s %9s %9s %9s %9s %9s %9s\n", "size", "echoed",
+	       "lost", "min(us)", "p50", "p90", "p99", "max", "jitter");
+}
+
+static void ping_print(ping_ctx * ctx)
+{
+	histogram_t *h = &ctx->rtt;
+
+	printf("%8d %8llu %6llu", ctx->size, (unsigned long long)ctx->echoed,
+	       (unsigned long long)ctx->lost);
+	if (h->count)
+		printf(" %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f", h->min / 1e3,
+		       histogram_percentile(h, 50) / 1e3,
+		       histogram_percentile(h, 90) / 1e3,
+		       histogram_percentile(h, 99) / 1e3, h->max / 1e3,
+		       ctx->echoed > 1 ?
+		       ctx->jitter_sum / 1e3 / (ctx->echoed - 1) : 0.0);
+	printf("\n");
+	if (ctx->late || ctx->corrupted || ctx->errors)
+		printf("%8s %llu late or unknown echoes, %llu bytes out of "
+		       "sync, %llu transfer errors\n", "",
+		       (unsigned long long)ctx->late,
+		       (unsigned long long)ctx->corrupted,
+		       (unsigned long long)ctx->errors);
+}
+
+static void ping_sweep(ping_ctx * ctx)
+{
+	double tput[32], peak = 0;
+	uint64_t p50[32];
+	int size, n = 0, i;
+
+	printf("Throughput sweep: %d probes in flight, %llus per size\n",
+	       PING_WINDOW, (unsigned long long)PING_SWEEP_NS / 1000000000ULL);
+	for (size = PING_SWEEP_MIN; (size <= PING_MAX_SIZE) && !stop_acc;
+	     size <<= 1, n++) {
+		ping_run(ctx, size, PING_WINDOW, 0, PING_SWEEP_NS);
+		tput[n] = ctx->end_ns > ctx->start_ns ?
+		    ctx->echoed_bytes * 1e9 / (ctx->end_ns - ctx->start_ns) :
+		    0;
+		p50[n] = histogram_percentile(&ctx->rtt, 50);
+		if (tput[n] > peak)
+			peak = tput[n];
+	}
+
+	for (i = 0, size = PING_SWEEP_MIN; i < n; i++, size <<= 1) {
+		int bar = peak > 0 ? (int)(tput[i] * 40 / peak + 0.5) : 0;
+
+		printf("%8d B |%-40.*s| %8.2f MB/s  p50 %9.1fus\n", size, bar,
+		       "########################################",
+		       tput[i] / 1e6, p50[i] / 1e3);
+	}
+}
+
+void ping_main(accessory_t * acc)
+{
+	static ping_ctx ctx;
+	char *sizes, *tok, *save;
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.acc = acc;
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	ctx.rasm = malloc(2 * PING_MAX_SIZE);
+	if (ctx.rasm == NULL)
+		goto end;
+	for (i = 0; i < PING_READS; i++) {
+		ctx.rx[i] = malloc(PING_READ_SIZE);
+		if (ctx.rx[i] == NULL)
+			goto end;
+	}
+	for (i = 0; i < PING_WINDOW; i++) {
+		int j;
+
+		ctx.tx[i].ctx = &ctx;
+		ctx.tx[i].buf = malloc(PING_MAX_SIZE);
+		if (ctx.tx[i].buf == NULL)
+			goto end;
+		for (j = PING_HEADER_SIZE; j < PING_MAX_SIZE; j++)
+			ctx.tx[i].buf[j] = j;
+	}
+
+	if (acc->ping) {
+		printf("Round-trip times, %d probes per size\n",
+		       acc->ping_count);
+		ping_print_header();
+
+		sizes = strdup(acc->ping);
+		for (tok = strtok_r(sizes, ",", &save); tok && !stop_acc;
+		     tok = strtok_r(NULL, ",", &save)) {
+			int size = atoi(tok);
+
+			if ((size < PING_HEADER_SIZE) || (size > PING_MAX_SIZE)) {
+				printf("%8s probe size must be between %d and "
+				       "%d\n", tok, PING_HEADER_SIZE,
+				       PING_MAX_SIZE);
+				continue;
+			}
+			ping_run(&ctx, size, 1, acc->ping_count, 0);
+			ping_print(&ctx);
+		}
+		free(sizes);
+	}
+
+	if (acc->ping_sweep)
+		ping_sweep(&ctx);
+
+end:
+	for (i = 0; i < PING_WINDOW; i++)
+		free(ctx.tx[i].buf);
+	for (i = 0; i < PING_READS; i++)
+		free(ctx.rx[i]);
+	free(ctx.rasm);
+	pthread_mutex_destroy(&ctx.lock);
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Linux ADK - ping.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _PING_H_
+#define _PING_H_
+
+#include <stdint.h>
+
+#include "linux-adk.h"
+
+/*
+ * Echo protocol: the host sends probes on AOA_ACCESSORY_EP_OUT, made of
+ * this header (little-endian) followed by size - PING_HEADER_SIZE bytes
+ * of payload. The accessory application writes back every byte it reads,
+ * unmodified, on AOA_ACCESSORY_EP_IN.
+ *
+ * Bulk reads end on a short packet, so both sides terminate transfers
+ * whose length is a multiple of wMaxPacketSize with a zero length packet:
+ * the host flags its probes with ADK_WRITE_ZLP, the echo side must do the
+ * same or its echo waits for more data.
+ */
+#define PING_MAGIC		0x504b4441u	/* "ADKP" */
+#define PING_HEADER_SIZE	24
+#define PING_MAX_SIZE		(256 * 1024)
+
+typedef struct {
+	uint32_t magic;
+	uint16_t run;		/* measurement the probe belongs to */
+	uint16_t flags;
+	uint32_t seq;
+	uint32_t size;		/* whole probe, header included */
+	uint64_t timestamp;	/* host send time, ns */
+} __attribute__ ((packed)) ping_header;
+
+/* Functions */
+extern void ping_main(accessory_t *acc);
+
+#endif /* _PING_H_ */
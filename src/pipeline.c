@@ -0,0 +1,256 @@
+/*
+ * Linux ADK - pipeline.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "histogram.h"
+#include "pipeline.h"
+#include "ring.h"
+#include "rt.h"
+#include "trace.h"
+
+/* Polling period of idle stages, for termination */
+#define PIPELINE_IDLE_MS	100
+
+struct pipeline_stage {
+	pipeline_t *p;
+	const char *name;
+	pipeline_fn fn;
+	void *ctx;
+	int prio;
+	int cpu;
+	ring_t *in;
+	ring_t *out;
+	pthread_t thread;
+	int done;
+	uint64_t buffers;
+	uint64_t bytes;
+	uint64_t busy_ns;
+	histogram_t latency;
+};
+
+struct pipeline {
+	unsigned int count;
+	unsigned int size;
+	pipeline_buf *bufs;
+	uint8_t *data;
+	ring_t *free;
+	int nstages;
+	struct pipeline_stage stages[PIPELINE_MAX_STAGES];
+	int started;
+	int stopping;
+	uint64_t start_ns;
+	uint64_t drops;
+	uint64_t dropped_bytes;
+};
+
+pipeline_t *pipeline_create(unsigned int count, unsigned int size)
+{
+	pipeline_t *p;
+	unsigned int i;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return NULL;
+
+	p->count = count;
+	p->size = size;
+	p->bufs = calloc(count, sizeof(*p->bufs));
+	p->free = ring_create(count);
+	if ((p->bufs == NULL) || (p->free == NULL) ||
+	    posix_memalign((void **)&p->data, 4096, (size_t)count * size))
+		goto error;
+
+	for (i = 0; i < count; i++) {
+		p->bufs[i].data = p->data + (size_t)i * size;
+		ring_push(p->free, &p->bufs[i]);
+	}
+
+	return p;
+
+error:
+	printf("Pipeline: unable to allocate %u buffers of %u bytes\n", count,
+	       size);
+	if (p->free)
+		ring_destroy(p->free);
+	free(p->bufs);
+	free(p);
+	return NULL;
+}
+
+/* Stages run in the order they are added */
+int pipeline_add_stage(pipeline_t * p, const char *name, pipeline_fn fn,
+		       void *ctx, int prio, int cpu)
+{
+	struct pipeline_stage *stage;
+
+	if (p->started || (p->nstages == PIPELINE_MAX_STAGES))
+		return -1;
+
+	stage = &p->stages[p->nstages];
+	memset(stage, 0, sizeof(*stage));
+	/* Every ring can hold all the buffers, pushing never fails */
+	stage->in = ring_create(p->count);
+	if (stage->in == NULL)
+		return -1;
+
+	stage->p = p;
+	stage->name = name;
+	stage->fn = fn;
+	stage->ctx = ctx;
+	stage->prio = prio;
+	stage->cpu = cpu;
+	histogram_init(&stage->latency);
+	p->nstages++;
+
+	return 0;
+}
+
+static void *stage_loop(void *arg)
+{
+	struct pipeline_stage *stage = arg;
+	pipeline_t *p = stage->p;
+	int index = stage - p->stages;
+	pipeline_buf *buf;
+
+	rt_configure_thread(stage->name, stage->prio, stage->cpu);
+
+	for (;;) {
+		uint64_t start, end;
+
+		buf = ring_pop(stage->in);
+		if (buf == NULL) {
+			/* Upstream done and nothing left: done too */
+			if (__atomic_load_n(index ? &p->stages[index - 1].done :
+					    &p->stopping, __ATOMIC_ACQUIRE) &&
+			    ring_empty(stage->in))
+				break;
+			ring_wait(stage->in, PIPELINE_IDLE_MS);
+			continue;
+		}
+
+		if (buf->len > 0) {
+			start = time_ns();
+			buf->len = stage->fn(stage->ctx, buf->data, buf->len);
+			end = time_ns();
+			stage->buffers++;
+			stage->bytes += buf->len > 0 ? buf->len : 0;
+			stage->busy_ns += end - start;
+			histogram_add(&stage->latency, end - start);
+		}
+
+		/* Dropped buffers still travel down, only the last stage frees */
+		ring_push(stage->out, buf);
+	}
+
+	__atomic_store_n(&stage->done, 1, __ATOMIC_RELEASE);
+	if (index + 1 < p->nstages)
+		ring_wake(p->stages[index + 1].in);
+
+	return NULL;
+}
+
+int pipeline_start(pipeline_t * p)
+{
+	int i;
+
+	if (!p->nstages)
+		return -1;
+
+	for (i = 0; i < p->nstages; i++)
+		p->stages[i].out = (i + 1 < p->nstages) ?
+		    p->stages[i + 1].in : p->free;
+
+	p->start_ns = time_ns();
+	for (i = 0; i < p->nstages; i++) {
+		if (pthread_create(&p->stages[i].thread, NULL, stage_loop,
+				   &p->stages[i]) != 0) {
+			printf("Pipeline: unable to start stage %s\n",
+			       p->stages[i].name);
+			return -1;
+		}
+		p->started = i + 1;
+	}
+
+	return 0;
+}
+
+/* Producer side: a free buffer to fill, NULL when all are in flight */
+pipeline_buf *pipeline_get(pipeline_t * p)
+{
+	pipeline_buf *buf = ring_pop(p->free);
+
+	if (buf)
+		buf->len = 0;
+	return buf;
+}
+
+/* Producer side: hands a filled buffer over to the first stage */
+void pipeline_put(pipeline_t * p, pipeline_buf * buf, int len)
+{
+	buf->len = len < (int)p->size ? len : (int)p->size;
+	ring_push(p->stages[0].in, buf);
+}
+
+/* Producer side: accounts for data lost for lack of free buffer */
+void pipeline_drop(pipeline_t * p, int len)
+{
+	p->drops++;
+	p->dropped_bytes += len;
+	trace(TRACE_DROP, 0, 0, len, p->drops);
+}
+
+void pipeline_close(pipeline_t * p)
+{
+	uint64_t elapsed = time_ns() - p->start_ns;
+	int i;
+
+	/* Stages drain what is queued and stop one after the other */
+	__atomic_store_n(&p->stopping, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < p->started; i++) {
+		ring_wake(p->stages[i].in);
+		pthread_join(p->stages[i].thread, NULL);
+	}
+
+	for (i = 0; i < p->started; i++) {
+		struct pipeline_stage *stage = &p->stages[i];
+
+		printf("Pipeline %s: %llu buffers, %llu bytes, busy %.1f%%\n",
+		       stage->name, (unsigned long long)stage->buffers,
+		       (unsigned long long)stage->bytes,
+		       elapsed ? 100.0 * stage->busy_ns / elapsed : 0.0);
+		histogram_print_line(&stage->latency, stage->name);
+	}
+	if (p->started)
+		printf("Pipeline: %llu buffers (%llu bytes) dropped for lack "
+		       "of free buffer\n", (unsigned long long)p->drops,
+		       (unsigned long long)p->dropped_bytes);
+
+	for (i = 0; i < p->nstages; i++)
+		ring_destroy(p->stages[i].in);
+	ring_destroy(p->free);
+	free(p->data);
+	free(p->bufs);
+	free(p);
+}
+#endif
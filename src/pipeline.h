@@ -0,0 +1,56 @@
+/*
+ * Linux ADK - pipeline.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdint.h>
+
+#define PIPELINE_MAX_STAGES	8
+
+/*
+ * Processing of a stage, run on its own thread. Works in place on the
+ * buffer it owns until it returns, and returns the number of bytes to
+ * hand over to the next stage, 0 to drop the buffer.
+ */
+typedef int (*pipeline_fn)(void *ctx, uint8_t *buf, int len);
+
+typedef struct {
+	uint8_t *data;
+	int len;
+} pipeline_buf;
+
+typedef struct pipeline pipeline_t;
+
+/*
+ * Buffers go round from a free ring to the producer (the USB thread),
+ * then through every stage, the last one giving them back. Rings between
+ * threads are SPSC, buffers are never copied and the producer never waits.
+ */
+extern pipeline_t *pipeline_create(unsigned int count, unsigned int size);
+extern int pipeline_add_stage(pipeline_t *p, const char *name,
+			      pipeline_fn fn, void *ctx, int prio, int cpu);
+extern int pipeline_start(pipeline_t *p);
+extern pipeline_buf *pipeline_get(pipeline_t *p);
+extern void pipeline_put(pipeline_t *p, pipeline_buf *buf, int len);
+extern void pipeline_drop(pipeline_t *p, int len);
+extern void pipeline_close(pipeline_t *p);
+
+#endif /* _PIPELINE_H_ */
@@ -0,0 +1,141 @@
+/*
+ * Linux ADK - ring.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ring.h"
+
+#define RING_CACHELINE	64
+
+struct ring {
+	/* Written by the consumer */
+	uint32_t head __attribute__ ((aligned(RING_CACHELINE)));
+	uint32_t waiting;
+	/* Written by the producer */
+	uint32_t tail __attribute__ ((aligned(RING_CACHELINE)));
+	/* Read-only */
+	uint32_t mask __attribute__ ((aligned(RING_CACHELINE)));
+	void **slots;
+};
+
+static void futex_wait(uint32_t *addr, uint32_t value, int timeout_ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* size is rounded up to a power of two */
+ring_t *ring_create(unsigned int size)
+{
+	ring_t *ring;
+	unsigned int count = 1;
+
+	while (count < size)
+		count <<= 1;
+
+	if (posix_memalign((void **)&ring, RING_CACHELINE, sizeof(*ring)))
+		return NULL;
+
+	ring->head = ring->tail = ring->waiting = 0;
+	ring->mask = count - 1;
+	ring->slots = calloc(count, sizeof(void *));
+	if (ring->slots == NULL) {
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void ring_destroy(ring_t * ring)
+{
+	free(ring->slots);
+	free(ring);
+}
+
+int ring_push(ring_t * ring, void *ptr)
+{
+	uint32_t tail = ring->tail;
+
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask)
+		return -1;
+
+	ring->slots[tail & ring->mask] = ptr;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence of ring_wait() so no wake-up gets lost */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED))
+		futex_wake(&ring->tail);
+
+	return 0;
+}
+
+void *ring_pop(ring_t * ring)
+{
+	uint32_t head = ring->head;
+	void *ptr;
+
+	if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	ptr = ring->slots[head & ring->mask];
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return ptr;
+}
+
+int ring_empty(ring_t * ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+	    __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/* Consumer side: sleeps until something is pushed, woken or timed out */
+void ring_wait(ring_t * ring, int timeout_ms)
+{
+	uint32_t tail;
+
+	__atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	if (tail == ring->head)
+		futex_wait(&ring->tail, tail, timeout_ms);
+	__atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+}
+
+void ring_wake(ring_t * ring)
+{
+	futex_wake(&ring->tail);
+}
+#endif
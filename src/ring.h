@@ -0,0 +1,41 @@
+/*
+ * Linux ADK - ring.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+/*
+ * Lock-free single producer / single consumer ring of pointers. Neither
+ * side ever blocks the other: pushing to a full ring or popping from an
+ * empty one fails immediately. The consumer may sleep in ring_wait(), the
+ * producer only issues a wake-up syscall when it does.
+ */
+typedef struct ring ring_t;
+
+/* Functions */
+extern ring_t *ring_create(unsigned int size);
+extern void ring_destroy(ring_t *ring);
+extern int ring_push(ring_t *ring, void *ptr);
+extern void *ring_pop(ring_t *ring);
+extern int ring_empty(ring_t *ring);
+extern void ring_wait(ring_t *ring, int timeout_ms);
+extern void ring_wake(ring_t *ring);
+
+#endif /* _RING_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Linux ADK - rt.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "linux-adk.h"
+#include "histogram.h"
+#include "rt.h"
+
+/* Amount of stack touched up-front so that page faults don't hit later */
+#define RT_STACK_PREFAULT	(256 * 1024)
+
+int rt_configure_thread(const char *name, int prio, int cpu)
+{
+	int ret;
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (ret) {
+			printf("%s: unable to pin to CPU %d: %s\n", name, cpu,
+			       strerror(ret));
+			return -1;
+		}
+	}
+
+	if (prio > 0) {
+		struct sched_param param;
+
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = prio;
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret) {
+			printf("%s: unable to set SCHED_FIFO priority %d: %s\n",
+			       name, prio, strerror(ret));
+			return -1;
+		}
+	}
+
+	if ((cpu >= 0) || (prio > 0))
+		printf("%s: SCHED_%s prio %d, CPU %d\n", name,
+		       prio > 0 ? "FIFO" : "OTHER", prio, cpu);
+
+	return 0;
+}
+
+void rt_prefault(void *buf, size_t len)
+{
+	volatile unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; i += 4096)
+		p[i] = p[i];
+	if (len)
+		p[len - 1] = p[len - 1];
+}
+
+static void rt_prefault_stack(void)
+{
+	unsigned char stack[RT_STACK_PREFAULT];
+
+	memset(stack, 0, sizeof(stack));
+	rt_prefault(stack, sizeof(stack));
+}
+
+int rt_lock_memory(void)
+{
+	/* Keep freed heap memory mapped so it stays locked and faulted in */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		printf("Unable to lock memory: %s\n", strerror(errno));
+		return -1;
+	}
+
+	rt_prefault_stack();
+	return 0;
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * Measures the wakeup latency of a periodic absolute timer in the
+ * scheduling environment of the USB threads, cyclictest style.
+ */
+int rt_measure_jitter(int prio, int cpu, unsigned int seconds)
+{
+	histogram_t h;
+	struct timespec next;
+	uint64_t end, overruns = 0;
+
+	if (rt_configure_thread("jitter", prio, cpu) < 0)
+		return -1;
+
+	histogram_init(&h);
+	printf("Measuring wakeup latency for %us (%dus period)...\n",
+	       seconds, RT_JITTER_INTERVAL_US);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	end = time_ns() + (uint64_t)seconds * 1000000000ULL;
+
+	while (!stop_acc) {
+		uint64_t expected, now;
+
+		timespec_add_ns(&next, RT_JITTER_INTERVAL_US * 1000);
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				    NULL))
+			continue;
+
+		now = time_ns();
+		expected = (uint64_t)next.tv_sec * 1000000000ULL + next.tv_nsec;
+		histogram_add(&h, now - expected);
+
+		/* Skip missed periods instead of bursting to catch up */
+		if (now - expected > RT_JITTER_INTERVAL_US * 1000) {
+			overruns++;
+			timespec_add_ns(&next, (now - expected) /
+					(RT_JITTER_INTERVAL_US * 1000) *
+					(RT_JITTER_INTERVAL_US * 1000));
+		}
+
+		if (now >= end)
+			break;
+	}
+
+	histogram_print(&h, "Wakeup latency");
+	printf("  %llu missed periods\n", (unsigned long long)overruns);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Linux ADK - rt.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _RT_H_
+#define _RT_H_
+
+#include <stddef.h>
+
+/* Period of the jitter measurement timer */
+#define RT_JITTER_INTERVAL_US	1000
+
+/* Functions */
+extern int rt_configure_thread(const char *name, int prio, int cpu);
+extern int rt_lock_memory(void);
+extern void rt_prefault(void *buf, size_t len);
+extern int rt_measure_jitter(int prio, int cpu, unsigned int seconds);
+
+#endif /* _RT_H_ */
@@ -0,0 +1,343 @@
+/*
+ * Linux ADK - shmring.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+
+/*
+ * Header, followed by the data area. Mapping offsets and sizes are kept
+ * multiple of the largest page size in use (64KiB on some arm64).
+ */
+#define SHMRING_HEADER_SIZE	65536
+#define SHMRING_CACHELINE	64
+
+struct shmring_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	/* Producer: data up to reserve may be being overwritten */
+	uint64_t reserve __attribute__ ((aligned(SHMRING_CACHELINE)));
+	uint64_t head;
+	uint64_t last;
+	uint64_t seq;
+	uint32_t futex;
+	uint32_t closed;
+	/* Readers */
+	uint32_t waiters __attribute__ ((aligned(SHMRING_CACHELINE)));
+};
+
+struct shmring {
+	struct shmring_header *hdr;
+	uint8_t *data;
+	void *map;
+	size_t map_size;
+	uint64_t size;
+	char *name;
+};
+
+#define SHMRING_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+#define SHMRING_RECORD(len)	(sizeof(shmring_record) + SHMRING_ALIGN(len))
+
+static void futex_wait(uint32_t *addr, uint32_t value, int timeout_ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	syscall(SYS_futex, addr, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Maps the header, then the data area twice in a row */
+static int shmring_map(shmring_t * ring, int fd, int prot)
+{
+	uint8_t *base;
+
+	ring->map_size = SHMRING_HEADER_SIZE + 2 * ring->size;
+	ring->map = mmap(NULL, ring->map_size, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->map == MAP_FAILED)
+		return -1;
+	base = ring->map;
+
+	if ((mmap(base, SHMRING_HEADER_SIZE, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+	    (mmap(base + SHMRING_HEADER_SIZE, ring->size, prot,
+		  MAP_SHARED | MAP_FIXED, fd,
+		  SHMRING_HEADER_SIZE) == MAP_FAILED) ||
+	    (mmap(base + SHMRING_HEADER_SIZE + ring->size, ring->size, prot,
+		  MAP_SHARED | MAP_FIXED, fd,
+		  SHMRING_HEADER_SIZE) == MAP_FAILED)) {
+		munmap(ring->map, ring->map_size);
+		return -1;
+	}
+
+	ring->hdr = ring->map;
+	ring->data = base + SHMRING_HEADER_SIZE;
+	return 0;
+}
+
+shmring_t *shmring_create(const char *name, size_t size)
+{
+	shmring_t *ring;
+	uint64_t count = SHMRING_HEADER_SIZE;
+	int fd;
+
+	while (count < size)
+		count <<= 1;
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL)
+		return NULL;
+	ring->size = count;
+	ring->name = strdup(name);
+
+	/* Readers attached to a previous instance keep their own mapping */
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0660);
+	if ((fd < 0) ||
+	    (ftruncate(fd, SHMRING_HEADER_SIZE + ring->size) < 0) ||
+	    (shmring_map(ring, fd, PROT_READ | PROT_WRITE) < 0)) {
+		printf("Unable to create shared memory ring %s: %s\n", name,
+		       strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(name);
+		}
+		free(ring->name);
+		free(ring);
+		return NULL;
+	}
+	close(fd);
+
+	ring->hdr->version = SHMRING_VERSION;
+	ring->hdr->size = ring->size;
+	/* Readers check the magic last */
+	__atomic_store_n(&ring->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+	printf("Publishing received data to shared memory ring %s (%llu KiB)\n",
+	       name, (unsigned long long)ring->size >> 10);
+	return ring;
+}
+
+int shmring_write(shmring_t * ring, const void *data, size_t len)
+{
+	struct shmring_header *hdr = ring->hdr;
+	uint64_t pos = hdr->head;
+	size_t rec = SHMRING_RECORD(len);
+	shmring_record *r;
+
+	if (rec > ring->size / 2)
+		return -1;
+
+	/* Tell readers what is about to be overwritten before doing it */
+	__atomic_store_n(&hdr->reserve, pos + rec, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	r = (shmring_record *) (ring->data + (pos & (ring->size - 1)));
+	r->seq = hdr->seq++;
+	r->len = len;
+	r->reserved = 0;
+	memcpy(r + 1, data, len);
+
+	__atomic_store_n(&hdr->head, pos + rec, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->last, pos, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&hdr->futex, 1, __ATOMIC_RELEASE);
+
+	/* Only pay for a syscall when somebody sleeps */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_RELAXED))
+		futex_wake(&hdr->futex);
+
+	return 0;
+}
+
+void shmring_destroy(shmring_t * ring)
+{
+	__atomic_store_n(&ring->hdr->closed, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->hdr->futex, 1, __ATOMIC_RELEASE);
+	futex_wake(&ring->hdr->futex);
+
+	munmap(ring->map, ring->map_size);
+	shm_unlink(ring->name);
+	free(ring->name);
+	free(ring);
+}
+
+/* Readers start from the live position, older data is not replayed */
+int shmring_open(shmring_reader * reader, const char *name)
+{
+	shmring_t *ring;
+	struct shmring_header hdr;
+	struct stat st;
+	int fd;
+
+	memset(reader, 0, sizeof(*reader));
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+
+	if ((fstat(fd, &st) < 0) || (st.st_size < SHMRING_HEADER_SIZE) ||
+	    (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+	    (hdr.magic != SHMRING_MAGIC) || (hdr.version != SHMRING_VERSION) ||
+	    ((uint64_t)st.st_size != SHMRING_HEADER_SIZE + hdr.size)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) {
+		close(fd);
+		return -1;
+	}
+	ring->size = hdr.size;
+	if (shmring_map(ring, fd, PROT_READ) < 0) {
+		close(fd);
+		free(ring);
+		return -1;
+	}
+	close(fd);
+
+	reader->ring = ring;
+	reader->pos = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+	reader->seq = __atomic_load_n(&ring->hdr->seq, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* Jumps to the newest record after being overrun */
+static void shmring_resync(shmring_reader * reader)
+{
+	reader->overruns++;
+	reader->pos = __atomic_load_n(&reader->ring->hdr->last,
+				      __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns the next record in place, NULL when there is none yet. The
+ * data may be overwritten by the producer while being used: only once
+ * shmring_next() confirmed it wasn't should the result be trusted.
+ */
+const void *shmring_peek(shmring_reader * reader, size_t *len, uint64_t *seq)
+{
+	shmring_t *ring = reader->ring;
+	const shmring_record *r;
+	uint64_t head, reserve;
+
+	head = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+	if (head == reader->pos)
+		return NULL;
+
+	/* The record header must not be in the area being overwritten */
+	reserve = __atomic_load_n(&ring->hdr->reserve, __ATOMIC_ACQUIRE);
+	if (reserve - reader->pos > ring->size)
+		shmring_resync(reader);
+
+	r = (const shmring_record *)(ring->data +
+				     (reader->pos & (ring->size - 1)));
+	*len = __atomic_load_n(&r->len, __ATOMIC_RELAXED);
+	*seq = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+	if (SHMRING_RECORD(*len) > ring->size / 2) {
+		/* Torn by the producer, start over from the newest */
+		shmring_resync(reader);
+		return shmring_peek(reader, len, seq);
+	}
+
+	return r + 1;
+}
+
+/*
+ * Releases the record returned by shmring_peek(). Returns 0 if it was
+ * intact all along, -1 if the producer overwrote it meanwhile.
+ */
+int shmring_next(shmring_reader * reader)
+{
+	shmring_t *ring = reader->ring;
+	const shmring_record *r;
+	uint64_t reserve, seq;
+	uint32_t len;
+
+	r = (const shmring_record *)(ring->data +
+				     (reader->pos & (ring->size - 1)));
+	len = __atomic_load_n(&r->len, __ATOMIC_RELAXED);
+	seq = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+
+	/* Data reads must be done before checking it is still valid */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	reserve = __atomic_load_n(&ring->hdr->reserve, __ATOMIC_RELAXED);
+	if (reserve - reader->pos > ring->size) {
+		shmring_resync(reader);
+		return -1;
+	}
+
+	/* Only a confirmed sequence number accounts for skipped records */
+	if (seq > reader->seq)
+		reader->lost += seq - reader->seq;
+	reader->seq = seq + 1;
+	reader->pos += SHMRING_RECORD(len);
+	reader->records++;
+	reader->bytes += len;
+	return 0;
+}
+
+/* Sleeps until a record is available: 0 then, -1 once the producer left */
+int shmring_wait(shmring_reader * reader, int timeout_ms)
+{
+	struct shmring_header *hdr = reader->ring->hdr;
+	uint32_t futex = __atomic_load_n(&hdr->futex, __ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) != reader->pos)
+		return 0;
+	if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE))
+		return -1;
+
+	__atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST) == reader->pos)
+		futex_wait(&hdr->futex, futex, timeout_ms);
+	__atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void shmring_close(shmring_reader * reader)
+{
+	munmap(reader->ring->map, reader->ring->map_size);
+	free(reader->ring);
+	reader->ring = NULL;
+}
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Linux ADK - shmring.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Named shared-memory ring publishing received data to local processes.
+ * The single producer never waits for readers: every chunk is a record
+ * with a sequence number, readers follow at their own pace and detect
+ * when the producer overwrote records they had not consumed yet.
+ *
+ * The data area is mapped twice back to back so that records wrapping
+ * around are contiguous: readers process them in place, without copy.
+ */
+#define SHMRING_MAGIC		0x474e5241u	/* "ARNG" */
+#define SHMRING_VERSION		1
+#define SHMRING_DEFAULT_NAME	"/linux-adk"
+#define SHMRING_DEFAULT_SIZE	(16 * 1024 * 1024)
+
+/* Record header, followed by len bytes of data padded to 8 bytes */
+typedef struct {
+	uint64_t seq;
+	uint32_t len;
+	uint32_t reserved;
+} shmring_record;
+
+typedef struct shmring shmring_t;
+
+typedef struct {
+	shmring_t *ring;
+	uint64_t pos;
+	uint64_t seq;
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t overruns;
+	uint64_t lost;
+} shmring_reader;
+
+/* Producer */
+extern shmring_t *shmring_create(const char *name, size_t size);
+extern int shmring_write(shmring_t *ring, const void *data, size_t len);
+extern void shmring_destroy(shmring_t *ring);
+
+/* Readers */
+extern int shmring_open(shmring_reader *reader, const char *name);
+extern const void *shmring_peek(shmring_reader *reader, size_t *len,
+				uint64_t *seq);
+extern int shmring_next(shmring_reader *reader);
+extern int shmring_wait(shmring_reader *reader, int timeout_ms);
+extern void shmring_close(shmring_reader *reader);
+
+#endif /* _SHMRING_H_ */
@@ -0,0 +1,493 @@
+/*
+ * Linux ADK - sink.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "histogram.h"
+#include "sink.h"
+
+/* Both appeared in Linux 5.6 */
+#ifndef IOSQE_ASYNC
+#define IOSQE_ASYNC		(1U << 4)
+#endif
+#ifndef IORING_FEAT_RW_CUR_POS
+#define IORING_FEAT_RW_CUR_POS	(1U << 3)
+#endif
+
+/*
+ * File sink for captured data. Data is copied in large aligned blocks from
+ * a fixed pool, full blocks are queued to io_uring and only reaped without
+ * waiting, so that the caller (the USB completion path) never blocks on
+ * storage. When the pool is exhausted, data is dropped and accounted for.
+ */
+
+struct sink_file {
+	int fd;
+	int inflight;
+	int closing;
+	uint64_t size;
+	uint64_t offset;
+};
+
+struct sink_block {
+	unsigned char *data;
+	size_t len;
+	struct iovec iov;
+	struct sink_file *file;
+};
+
+struct sink_ring {
+	int fd;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+	unsigned int features;
+};
+
+struct sink {
+	struct sink_ring ring;
+	int use_ring;
+	struct sink_block blocks[SINK_BLOCKS];
+	struct sink_block *free_blocks[SINK_BLOCKS];
+	int nfree;
+	int inflight;
+	struct sink_block *cur;
+	struct sink_file *file;
+	const char *path;
+	int direct;
+	uint64_t rotate_size;
+	uint64_t rotate_ns;
+	uint64_t opened_ns;
+	uint64_t retry_ns;	/* next rotation attempt after a failure */
+	unsigned int index;
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t errors;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static int ring_init(struct sink_ring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	ring->features = p.features;
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring->fd,
+			    IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+		goto error0;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size,
+				    PROT_READ | PROT_WRITE,
+				    MAP_SHARED | MAP_POPULATE, ring->fd,
+				    IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED)
+			goto error1;
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd,
+			  IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto error2;
+
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_ptr +
+					 p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_ptr +
+					  p.sq_off.array);
+	ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr +
+					 p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr +
+					     p.cq_off.cqes);
+	return 0;
+
+error2:
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+error1:
+	munmap(ring->sq_ptr, ring->sq_size);
+error0:
+	close(ring->fd);
+	return -1;
+}
+
+static void ring_exit(struct sink_ring *ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+}
+
+static struct sink_file *file_open(sink_t * sink)
+{
+	struct sink_file *file;
+	char name[4096];
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	if (sink->rotate_size || sink->rotate_ns)
+		snprintf(name, sizeof(name), "%s.%04u", sink->path,
+			 sink->index++);
+	else
+		snprintf(name, sizeof(name), "%s", sink->path);
+
+	file = calloc(1, sizeof(*file));
+	if (file == NULL)
+		return NULL;
+
+	if (sink->direct)
+		flags |= O_DIRECT;
+
+	file->fd = open(name, flags, 0644);
+	if (file->fd < 0) {
+		printf("Unable to open %s: %s\n", name, strerror(errno));
+		free(file);
+		/* Retry under the same name */
+		if (sink->rotate_size || sink->rotate_ns)
+			sink->index--;
+		return NULL;
+	}
+
+	sink->opened_ns = time_ns();
+	return file;
+}
+
+/* Closes a file once it is retired and its last write has completed */
+static void file_put(struct sink_file *file)
+{
+	if (!file->closing || file->inflight)
+		return;
+
+	/* Drop the O_DIRECT padding of the last block */
+	if (file->offset != file->size)
+		if (ftruncate(file->fd, file->size))
+			printf("Unable to truncate capture file: %s\n",
+			       strerror(errno));
+	close(file->fd);
+	free(file);
+}
+
+static void block_done(sink_t * sink, struct sink_block *block, int res)
+{
+	if ((res < 0) || ((size_t)res != block->iov.iov_len)) {
+		if (!sink->errors)
+			printf("Capture write failed: %s\n",
+			       res < 0 ? strerror(-res) : "short write");
+		sink->errors++;
+	}
+
+	block->file->inflight--;
+	file_put(block->file);
+	block->file = NULL;
+	block->len = 0;
+	sink->free_blocks[sink->nfree++] = block;
+	sink->inflight--;
+}
+
+static void sink_reap(sink_t * sink, int wait)
+{
+	struct sink_ring *ring = &sink->ring;
+	unsigned int head, tail;
+
+	if (!sink->use_ring)
+		return;
+
+	if (wait && sink->inflight)
+		sys_io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+		block_done(sink, (struct sink_block *)(uintptr_t)cqe->user_data,
+			   cqe->res);
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void sink_submit(sink_t * sink, struct sink_block *block)
+{
+	struct sink_ring *ring = &sink->ring;
+	struct sink_file *file = sink->file;
+	struct io_uring_sqe *sqe;
+	unsigned int tail, index;
+	size_t len = block->len;
+	uint64_t offset = file->offset;
+
+	/* O_DIRECT needs whole aligned blocks, the file is truncated later */
+	if (sink->direct && (len % SINK_ALIGN)) {
+		size_t padded = (len + SINK_ALIGN - 1) & ~(SINK_ALIGN - 1);
+
+		memset(block->data + len, 0, padded - len);
+		len = padded;
+	}
+
+	block->iov.iov_base = block->data;
+	block->iov.iov_len = len;
+	block->file = file;
+	file->inflight++;
+	file->size += block->len;
+	file->offset += len;
+	sink->inflight++;
+
+	if (!sink->use_ring) {
+		ssize_t ret = pwrite(file->fd, block->data, len, offset);
+
+		block_done(sink, block, ret < 0 ? -errno : ret);
+		return;
+	}
+
+	tail = *ring->sq_tail;
+	index = tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = file->fd;
+	sqe->addr = (uintptr_t)&block->iov;
+	sqe->len = 1;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t)block;
+	/*
+	 * Buffered writes would otherwise copy the block to the page cache
+	 * inline, in io_uring_enter() on the USB thread: punt them to the
+	 * io_uring workers. O_DIRECT writes are already asynchronous.
+	 */
+	if (!sink->direct && (ring->features & IORING_FEAT_RW_CUR_POS))
+		sqe->flags |= IOSQE_ASYNC;
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (sys_io_uring_enter(ring->fd, 1, 0, 0) < 0) {
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+		block_done(sink, block, -errno);
+	}
+}
+
+static int sink_rotate_due(sink_t * sink)
+{
+	return (sink->rotate_size && (sink->file->size >= sink->rotate_size))
+	    || (sink->rotate_ns &&
+		(time_ns() - sink->opened_ns >= sink->rotate_ns));
+}
+
+/*
+ * Queues the current partial block and switches to the next file. If the
+ * next file cannot be opened, the capture goes on in the current one and
+ * the rotation is retried a second later.
+ */
+static void sink_rotate(sink_t * sink)
+{
+	struct sink_file *file = sink->file, *next;
+	uint64_t now = time_ns();
+
+	if (now < sink->retry_ns)
+		return;
+
+	next = file_open(sink);
+	if (next == NULL) {
+		printf("Capture rotation failed, still writing to the "
+		       "previous file\n");
+		sink->retry_ns = now + 1000000000ULL;
+		return;
+	}
+
+	if (sink->cur && sink->cur->len) {
+		sink_submit(sink, sink->cur);
+		sink->cur = NULL;
+	}
+
+	file->closing = 1;
+	sink->file = next;
+	file_put(file);
+}
+
+sink_t *sink_open(const char *path, int direct, uint64_t rotate_size,
+		  unsigned int rotate_time)
+{
+	sink_t *sink;
+	int i;
+
+	sink = calloc(1, sizeof(*sink));
+	if (sink == NULL)
+		return NULL;
+
+	sink->path = path;
+	sink->direct = direct;
+	sink->rotate_size = rotate_size;
+	sink->rotate_ns = (uint64_t)rotate_time * 1000000000ULL;
+
+	for (i = 0; i < SINK_BLOCKS; i++) {
+		if (posix_memalign((void **)&sink->blocks[i].data, SINK_ALIGN,
+				   SINK_BLOCK_SIZE))
+			goto error;
+		/* Prefault now rather than in the data path */
+		memset(sink->blocks[i].data, 0, SINK_BLOCK_SIZE);
+		sink->free_blocks[sink->nfree++] = &sink->blocks[i];
+	}
+
+	if (ring_init(&sink->ring, SINK_BLOCKS) == 0)
+		sink->use_ring = 1;
+	else
+		printf("io_uring unavailable (%s), using blocking writes\n",
+		       strerror(errno));
+
+	sink->file = file_open(sink);
+	if (sink->file == NULL)
+		goto error;
+
+	printf("Capturing to %s%s\n", path, direct ? " (O_DIRECT)" : "");
+	return sink;
+
+error:
+	if (sink->use_ring)
+		ring_exit(&sink->ring);
+	for (i = 0; i < SINK_BLOCKS; i++)
+		free(sink->blocks[i].data);
+	free(sink);
+	return NULL;
+}
+
+int sink_write(sink_t * sink, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	sink_reap(sink, 0);
+
+	if (sink->file == NULL) {
+		sink->dropped += len;
+		return -1;
+	}
+
+	while (len) {
+		size_t chunk;
+
+		if (sink->cur == NULL) {
+			if (!sink->nfree) {
+				sink->dropped += len;
+				return -1;
+			}
+			sink->cur = sink->free_blocks[--sink->nfree];
+		}
+
+		chunk = SINK_BLOCK_SIZE - sink->cur->len;
+		if (chunk > len)
+			chunk = len;
+		memcpy(sink->cur->data + sink->cur->len, p, chunk);
+		sink->cur->len += chunk;
+		sink->written += chunk;
+		p += chunk;
+		len -= chunk;
+
+		if (sink->cur->len == SINK_BLOCK_SIZE) {
+			sink_submit(sink, sink->cur);
+			sink->cur = NULL;
+		}
+	}
+
+	if (sink_rotate_due(sink))
+		sink_rotate(sink);
+
+	return 0;
+}
+
+void sink_close(sink_t * sink)
+{
+	int i;
+
+	if (sink->cur && sink->cur->len && sink->file)
+		sink_submit(sink, sink->cur);
+
+	while (sink->inflight)
+		sink_reap(sink, 1);
+
+	if (sink->file) {
+		sink->file->closing = 1;
+		file_put(sink->file);
+	}
+
+	printf("Captured %llu bytes (%llu dropped, %llu write errors)\n",
+	       (unsigned long long)sink->written,
+	       (unsigned long long)sink->dropped,
+	       (unsigned long long)sink->errors);
+
+	if (sink->use_ring)
+		ring_exit(&sink->ring);
+	for (i = 0; i < SINK_BLOCKS; i++)
+		free(sink->blocks[i].data);
+	free(sink);
+}
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Linux ADK - sink.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Buffer pool: blocks are written as a whole once full */
+#define SINK_BLOCK_SIZE		(1024 * 1024)
+#define SINK_BLOCKS		16
+/* Alignment of buffers, offsets and sizes required by O_DIRECT */
+#define SINK_ALIGN		4096
+
+typedef struct sink sink_t;
+
+/* Functions */
+extern sink_t *sink_open(const char *path, int direct, uint64_t rotate_size,
+			 unsigned int rotate_time);
+extern int sink_write(sink_t *sink, const void *data, size_t len);
+extern void sink_close(sink_t *sink);
+
+#endif /* _SINK_H_ */
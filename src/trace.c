@@ -0,0 +1,135 @@
+/*
+ * Linux ADK - trace.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "adk.h"
+#include "trace.h"
+
+__thread trace_ring *adk_trace_self;
+
+/* Rings are never freed so that exited threads still get dumped */
+static trace_ring *trace_rings;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+trace_ring *adk_trace_ring_alloc(void)
+{
+	trace_ring *ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL)
+		return NULL;
+
+	ring->tid = syscall(SYS_gettid);
+
+	pthread_mutex_lock(&trace_lock);
+	ring->next = trace_rings;
+	__atomic_store_n(&trace_rings, ring, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace_lock);
+
+	adk_trace_self = ring;
+	return ring;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+
+		if (ret <= 0)
+			return -1;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes every ring to path. Only uses system calls so that it can be
+ * called from a signal handler after a crash.
+ */
+int adk_trace_dump(const char *path)
+{
+	trace_dump_header hdr;
+	trace_ring *ring, *first;
+	int fd;
+
+	first = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.record_size = sizeof(trace_record);
+	for (ring = first; ring; ring = ring->next)
+		hdr.ring_count++;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+
+	if (write_all(fd, &hdr, sizeof(hdr)))
+		goto error;
+
+	for (ring = first; ring; ring = ring->next) {
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t start = head > TRACE_RING_SIZE ?
+		    head - TRACE_RING_SIZE : 0;
+		unsigned int first_idx = start & (TRACE_RING_SIZE - 1);
+		trace_dump_ring rhdr;
+
+		rhdr.tid = ring->tid;
+		rhdr.count = head - start;
+		rhdr.lost = start;
+		if (write_all(fd, &rhdr, sizeof(rhdr)))
+			goto error;
+
+		/* Oldest records first, the ring may have wrapped */
+		if (first_idx + rhdr.count > TRACE_RING_SIZE) {
+			if (write_all(fd, &ring->records[first_idx],
+				      (TRACE_RING_SIZE - first_idx) *
+				      sizeof(trace_record)) ||
+			    write_all(fd, ring->records,
+				      (first_idx + rhdr.count -
+				       TRACE_RING_SIZE) *
+				      sizeof(trace_record)))
+				goto error;
+		} else if (write_all(fd, &ring->records[first_idx],
+				     rhdr.count * sizeof(trace_record))) {
+			goto error;
+		}
+	}
+
+	close(fd);
+	return 0;
+
+error:
+	close(fd);
+	return -1;
+}
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Linux ADK - trace.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Binary tracing: every thread records compact events in its own ring,
+ * without locks nor system calls, and the rings are dumped to a file on
+ * exit to be decoded by adk-trace.
+ */
+#define TRACE_RING_SIZE		16384	/* records, power of 2 */
+#define TRACE_MAGIC		"ADKTRACE"
+#define TRACE_VERSION		1
+#define TRACE_DEFAULT_FILE	"/tmp/linux-adk.trace"
+
+/* Events */
+#define TRACE_SUBMIT		1	/* transfer submitted */
+#define TRACE_COMPLETE		2	/* transfer completed */
+#define TRACE_ERROR		3	/* submission or event handling error */
+#define TRACE_WAKEUP		4	/* event thread woken up */
+#define TRACE_DROP		5	/* received data dropped */
+
+/* Structures */
+typedef struct {
+	uint64_t ts;		/* CLOCK_MONOTONIC, ns */
+	uint16_t event;
+	uint8_t endpoint;	/* 0 for control transfers */
+	uint8_t reserved;
+	int32_t status;		/* transfer status for TRACE_COMPLETE,
+				   libusb error code otherwise */
+	uint32_t length;
+	uint32_t arg;		/* event specific, e.g. HID id */
+} trace_record;
+
+typedef struct _trace_ring {
+	uint64_t head;
+	uint32_t tid;
+	struct _trace_ring *next;
+	trace_record records[TRACE_RING_SIZE];
+} trace_ring;
+
+/* Dump file layout: header, then per ring a trace_dump_ring and records */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t ring_count;
+	uint32_t reserved;
+} trace_dump_header;
+
+typedef struct {
+	uint32_t tid;
+	uint32_t count;
+	uint64_t lost;
+} trace_dump_ring;
+
+#ifdef WIN32
+#define trace(event, endpoint, status, length, arg)
+#else
+extern __thread trace_ring *adk_trace_self;
+
+/* Functions, adk_trace_dump() being declared in adk.h */
+extern trace_ring *adk_trace_ring_alloc(void);
+
+static inline uint64_t trace_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void trace(uint16_t event, uint8_t endpoint, int32_t status,
+			 uint32_t length, uint32_t arg)
+{
+	trace_ring *ring = adk_trace_self;
+	trace_record *rec;
+
+	if (ring == NULL) {
+		ring = adk_trace_ring_alloc();
+		if (ring == NULL)
+			return;
+	}
+
+	/* Single writer: fill the slot, then publish it */
+	rec = &ring->records[ring->head & (TRACE_RING_SIZE - 1)];
+	rec->ts = trace_clock();
+	rec->event = event;
+	rec->endpoint = endpoint;
+	rec->status = status;
+	rec->length = length;
+	rec->arg = arg;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+#endif /* _TRACE_H_ */
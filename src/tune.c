@@ -0,0 +1,304 @@
+/*
+ * Linux ADK - tune.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef WIN32
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "histogram.h"
+#include "tune.h"
+
+/*
+ * Coordinate hill climbing: every epoch measures one neighbour of the best
+ * known (size, depth), which becomes the new best if it is better by more
+ * than TUNE_MARGIN_PCT, the same move being tried again. Once no move
+ * improves, the result is cached and only monitored: a large drop of the
+ * throughput (hub, link speed, phone load) restarts the search.
+ */
+#define TUNE_MARGIN_PCT		5
+#define TUNE_DRIFT_PCT		50
+#define TUNE_DEFAULT_SIZE_LOG	14	/* 16 KiB */
+#define TUNE_DEFAULT_DEPTH_LOG	2	/* 4 transfers */
+#define TUNE_MOVES		4
+
+static const int moves[TUNE_MOVES][2] = {
+	{ 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }
+};
+
+struct tune {
+	char *cache;
+	char *key;
+	uint64_t target_ns;
+	int size_log;
+	int depth_log;
+	int best_size_log;
+	int best_depth_log;
+	uint64_t best_tput;
+	uint64_t best_p99;
+	int measured;
+	int move;
+	int settled;
+	uint64_t settled_tput;
+	uint64_t epoch_start;
+	uint64_t epoch_bytes;
+	histogram_t latency;
+	unsigned int steps;
+};
+
+static int cache_load(tune_t * tune)
+{
+	char line[256], key[200];
+	int size, depth, found = 0;
+	FILE *f;
+
+	f = fopen(tune->cache, "r");
+	if (f == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%199s %d %d", key, &size, &depth) != 3)
+			continue;
+		if (strcmp(key, tune->key))
+			continue;
+		if ((size < TUNE_MIN_SIZE_LOG) || (size > TUNE_MAX_SIZE_LOG) ||
+		    (depth < 0) || (depth > TUNE_MAX_DEPTH_LOG))
+			continue;
+		tune->size_log = size;
+		tune->depth_log = depth;
+		found = 1;
+	}
+
+	fclose(f);
+	return found ? 0 : -1;
+}
+
+/* Rewrites the cache with the entry of this device replaced */
+static void cache_save(tune_t * tune)
+{
+	char line[256], key[200], *tmp;
+	FILE *in, *out;
+
+	tmp = malloc(strlen(tune->cache) + 5);
+	if (tmp == NULL)
+		return;
+	sprintf(tmp, "%s.new", tune->cache);
+
+	out = fopen(tmp, "w");
+	if (out == NULL) {
+		printf("Tuning: unable to write %s\n", tmp);
+		free(tmp);
+		return;
+	}
+
+	in = fopen(tune->cache, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if ((sscanf(line, "%199s", key) == 1) &&
+			    (strcmp(key, tune->key) == 0))
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s %d %d\n", tune->key, tune->best_size_log,
+		tune->best_depth_log);
+
+	if (fclose(out) == 0)
+		rename(tmp, tune->cache);
+	else
+		unlink(tmp);
+	free(tmp);
+}
+
+/* Is the last epoch better than the best one */
+static int tune_better(tune_t * tune, uint64_t tput, uint64_t p99)
+{
+	if (tune->target_ns) {
+		int ok = p99 <= tune->target_ns;
+		int best_ok = tune->best_p99 <= tune->target_ns;
+
+		if (ok != best_ok)
+			return ok;
+		/* None meets the target, get closer to it */
+		if (!ok)
+			return p99 * (100 + TUNE_MARGIN_PCT) <
+			    tune->best_p99 * 100;
+	}
+
+	return tput * 100 > tune->best_tput * (100 + TUNE_MARGIN_PCT);
+}
+
+/* Applies the next valid move from the best point, 0 once all are done */
+static int tune_try(tune_t * tune)
+{
+	for (; tune->move < TUNE_MOVES; tune->move++) {
+		int size = tune->best_size_log + moves[tune->move][0];
+		int depth = tune->best_depth_log + moves[tune->move][1];
+
+		if ((size < TUNE_MIN_SIZE_LOG) || (size > TUNE_MAX_SIZE_LOG) ||
+		    (depth < 0) || (depth > TUNE_MAX_DEPTH_LOG))
+			continue;
+
+		tune->size_log = size;
+		tune->depth_log = depth;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void tune_epoch(tune_t * tune, uint64_t now)
+{
+	uint64_t elapsed = now - tune->epoch_start;
+	uint64_t tput = tune->epoch_bytes * 1000000000ULL / elapsed;
+	uint64_t p99 = histogram_percentile(&tune->latency, 99.0);
+
+	if (!tune->measured) {
+		/* Reference measurement of the starting point */
+		tune->measured = 1;
+		tune->best_tput = tput;
+		tune->best_p99 = p99;
+		if (tune->settled)
+			tune->settled_tput = tput;
+	} else if (tune->settled) {
+		if (tput * 100 >= tune->settled_tput * TUNE_DRIFT_PCT)
+			return;
+		printf("Tuning: throughput dropped to %.2f MB/s, "
+		       "searching again\n", tput / 1e6);
+		tune->settled = 0;
+		tune->best_tput = tput;
+		tune->best_p99 = p99;
+		tune->move = 0;
+	} else if (tune_better(tune, tput, p99)) {
+		tune->best_size_log = tune->size_log;
+		tune->best_depth_log = tune->depth_log;
+		tune->best_tput = tput;
+		tune->best_p99 = p99;
+		tune->steps++;
+		printf("Tuning: %d x %d, %.2f MB/s, p99 %llu us\n",
+		       1 << tune->size_log, 1 << tune->depth_log, tput / 1e6,
+		       (unsigned long long)p99 / 1000);
+	} else {
+		tune->move++;
+	}
+
+	if (!tune->settled && tune_try(tune))
+		return;
+
+	/* Nothing better around: settle on the best point */
+	tune->size_log = tune->best_size_log;
+	tune->depth_log = tune->best_depth_log;
+	if (!tune->settled) {
+		tune->settled = 1;
+		tune->settled_tput = tune->best_tput;
+		printf("Tuning: settled on %d x %d, %.2f MB/s, p99 %llu us\n",
+		       1 << tune->size_log, 1 << tune->depth_log,
+		       tune->best_tput / 1e6,
+		       (unsigned long long)tune->best_p99 / 1000);
+		cache_save(tune);
+	}
+}
+
+tune_t *tune_open(const char *cache, const char *key,
+		  unsigned int latency_target_us)
+{
+	tune_t *tune;
+
+	tune = calloc(1, sizeof(*tune));
+	if (tune == NULL)
+		return NULL;
+
+	/* Parameters tuned for another target are of no use */
+	tune->cache = strdup(cache);
+	tune->key = malloc(strlen(key) + 32);
+	if ((tune->cache == NULL) || (tune->key == NULL)) {
+		tune_close(tune);
+		return NULL;
+	}
+	if (latency_target_us)
+		sprintf(tune->key, "%s@p99<=%uus", key, latency_target_us);
+	else
+		sprintf(tune->key, "%s@throughput", key);
+	tune->target_ns = (uint64_t)latency_target_us * 1000;
+
+	if (cache_load(tune) == 0) {
+		printf("Tuning: %s starts from cached %d x %d\n", tune->key,
+		       1 << tune->size_log, 1 << tune->depth_log);
+		tune->settled = 1;
+	} else {
+		printf("Tuning: %s not in %s, searching\n", tune->key,
+		       cache);
+		tune->size_log = TUNE_DEFAULT_SIZE_LOG;
+		tune->depth_log = TUNE_DEFAULT_DEPTH_LOG;
+	}
+	tune->best_size_log = tune->size_log;
+	tune->best_depth_log = tune->depth_log;
+
+	histogram_init(&tune->latency);
+	tune->epoch_start = time_ns();
+
+	return tune;
+}
+
+void tune_params(tune_t * tune, int *size, int *depth)
+{
+	*size = 1 << tune->size_log;
+	*depth = 1 << tune->depth_log;
+}
+
+/*
+ * Accounts for a completed transfer, len being 0 for a timeout. Returns 1
+ * when the parameters to use changed.
+ */
+int tune_complete(tune_t * tune, int len, uint64_t latency_ns)
+{
+	uint64_t now = time_ns();
+	int size = tune->size_log, depth = tune->depth_log;
+
+	if (len > 0) {
+		tune->epoch_bytes += len;
+		histogram_add(&tune->latency, latency_ns);
+	}
+
+	if (now - tune->epoch_start < TUNE_EPOCH_NS)
+		return 0;
+
+	/* Idle link, nothing to learn from */
+	if (tune->epoch_bytes)
+		tune_epoch(tune, now);
+
+	tune->epoch_start = now;
+	tune->epoch_bytes = 0;
+	histogram_init(&tune->latency);
+
+	return (size != tune->size_log) || (depth != tune->depth_log);
+}
+
+void tune_close(tune_t * tune)
+{
+	/* Keep the best point found even if the search didn't complete */
+	if (tune->steps && !tune->settled)
+		cache_save(tune);
+	free(tune->cache);
+	free(tune->key);
+	free(tune);
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Linux ADK - tune.h
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include <stdint.h>
+
+/* Search space: transfer sizes and queue depths are powers of two */
+#define TUNE_MIN_SIZE_LOG	9	/* 512 bytes */
+#define TUNE_MAX_SIZE_LOG	18	/* 256 KiB */
+#define TUNE_MAX_DEPTH_LOG	5	/* 32 transfers */
+#define TUNE_MAX_SIZE		(1 << TUNE_MAX_SIZE_LOG)
+#define TUNE_MAX_DEPTH		(1 << TUNE_MAX_DEPTH_LOG)
+
+/* Duration of the measurement of every candidate */
+#define TUNE_EPOCH_NS		500000000ULL
+
+typedef struct tune tune_t;
+
+/*
+ * Tuner of the bulk IN transfer size and queue depth for the device
+ * identified by key. With latency_target_us at 0 the throughput is
+ * maximized, otherwise the best throughput keeping the 99th percentile
+ * of the transfers fill time under the target. Results are cached per
+ * key and target.
+ */
+extern tune_t *tune_open(const char *cache, const char *key,
+			 unsigned int latency_target_us);
+extern void tune_params(tune_t *tune, int *size, int *depth);
+extern int tune_complete(tune_t *tune, int len, uint64_t latency_ns);
+extern void tune_close(tune_t *tune);
+
+#endif /* _TUNE_H_ */
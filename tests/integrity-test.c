@@ -0,0 +1,157 @@
+/*
+ * Linux ADK - integrity-test.c
+ *
+ * Copyright (C) 2026 - Gary Bisson <bisson.gary@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "integrity.h"
+
+#define BLOCKS		3
+#define BLOCK_LEN	1000
+
+static uint8_t stream[BLOCKS * (BLOCK_LEN + INTEGRITY_OVERHEAD)];
+static uint8_t copy[sizeof(stream)];
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			printf("%s:%d: %s failed\n", __FILE__,		\
+			       __LINE__, #cond);			\
+			failures++;					\
+		}							\
+	} while (0)
+
+/* Blocks of BLOCK_LEN bytes, block i filled with i + 1 */
+static size_t build_stream(void)
+{
+	size_t off = 0;
+	int i;
+
+	for (i = 0; i < BLOCKS; i++) {
+		memset(stream + off + INTEGRITY_HEADER, i + 1, BLOCK_LEN);
+		off += integrity_seal(stream + off, BLOCK_LEN);
+	}
+
+	return off;
+}
+
+/* Feeds the stream in chunks of at most step bytes, returns the payload */
+static size_t check_stream(integrity_t *ctx, size_t len, size_t step)
+{
+	size_t in = 0, out = 0;
+
+	memcpy(copy, stream, len);
+	integrity_init(ctx);
+	while (in < len) {
+		size_t n = (len - in < step) ? len - in : step;
+
+		/* The payload of the chunk lands at its start */
+		n = integrity_check(ctx, copy + in, n);
+		memmove(copy + out, copy + in, n);
+		out += n;
+		in += (len - in < step) ? len - in : step;
+	}
+
+	return out;
+}
+
+static void test_clean(size_t step)
+{
+	integrity_t ctx;
+	size_t len = build_stream();
+
+	CHECK(check_stream(&ctx, len, step) == BLOCKS * BLOCK_LEN);
+	CHECK(ctx.blocks == BLOCKS);
+	CHECK(ctx.mismatches == 0);
+	CHECK(ctx.framing_errors == 0);
+}
+
+/* A corrupted length loses its block only, the next one is accepted */
+static void test_length(size_t step)
+{
+	integrity_t ctx;
+	size_t len = build_stream();
+	size_t out;
+
+	stream[BLOCK_LEN + INTEGRITY_OVERHEAD + 4] ^= 0x01;
+	out = check_stream(&ctx, len, step);
+
+	CHECK(out == 2 * BLOCK_LEN);
+	CHECK(ctx.blocks == 2);
+	CHECK(ctx.mismatches == 0);
+	CHECK(ctx.framing_errors == 1);
+	CHECK(copy[0] == 1);
+	CHECK(copy[BLOCK_LEN] == 3);
+	CHECK(copy[out - 1] == 3);
+}
+
+/* A corrupted payload is reported, the stream stays in step */
+static void test_payload(size_t step)
+{
+	integrity_t ctx;
+	size_t len = build_stream();
+
+	stream[BLOCK_LEN + INTEGRITY_OVERHEAD + INTEGRITY_HEADER + 10] ^= 0x80;
+
+	CHECK(check_stream(&ctx, len, step) == BLOCKS * BLOCK_LEN);
+	CHECK(ctx.blocks == BLOCKS);
+	CHECK(ctx.mismatches == 1);
+	CHECK(ctx.framing_errors == 0);
+}
+
+/*
+ * Bytes missing from the first payload: it runs into the second header,
+ * and the checker finds its way back at the third block.
+ */
+static void test_lost_bytes(size_t step)
+{
+	integrity_t ctx;
+	size_t len = build_stream();
+	size_t cut = INTEGRITY_HEADER + 100;
+	size_t out;
+
+	memmove(stream + cut, stream + cut + 64, len - cut - 64);
+	len -= 64;
+	out = check_stream(&ctx, len, step);
+
+	CHECK(ctx.blocks == 2);
+	CHECK(ctx.mismatches == 1);
+	CHECK(ctx.framing_errors == 1);
+	CHECK(out == 2 * BLOCK_LEN);
+	CHECK(copy[out - 1] == 3);
+}
+
+int main(void)
+{
+	static const size_t steps[] = { 1, 7, 512, sizeof(stream) };
+	unsigned int i;
+
+	for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+		test_clean(steps[i]);
+		test_length(steps[i]);
+		test_payload(steps[i]);
+		test_lost_bytes(steps[i]);
+	}
+
+	printf("integrity-test: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}